@@ -0,0 +1,277 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+using namespace bench;
+using namespace std;
+
+// a sample shorter than this is mostly timer noise
+#define MIN_SAMPLE_SECONDS 0.01
+
+// a median this much slower than the baseline fails the run
+#define DEFAULT_THRESHOLD 5.0
+
+struct Case {
+	const char *name;
+	Function function;
+};
+
+struct Result {
+	string name;
+	double median, p10, p90, min, mean; // ns per iteration
+	size_t samples;
+	size_t iterations;
+	double itemsPerSecond;
+};
+
+static vector<Case> &cases()
+{
+	static vector<Case> registered;
+	return registered;
+}
+
+Registrar::Registrar(const char *name, Function function)
+{
+	cases().push_back({name, function});
+}
+
+State::State(size_t samples, size_t warmup, double minSampleSeconds) :
+m_samples(samples), m_warmup(warmup), m_minSampleSeconds(minSampleSeconds)
+{
+
+}
+
+void State::setItems(size_t items)
+{
+	m_items = items;
+}
+
+const vector<double> &State::samples() const
+{
+	return m_results;
+}
+
+size_t State::iterations() const
+{
+	return m_iterations;
+}
+
+size_t State::items() const
+{
+	return m_items;
+}
+
+// nearest rank of sorted values
+static double percentile(const vector<double> &sorted, double p)
+{
+	size_t rank = size_t(ceil(p * sorted.size()));
+	return sorted[min(sorted.size() - 1, rank ? rank - 1 : 0)];
+}
+
+static Result summarize(const char *name, const State &state)
+{
+	vector<double> sorted = state.samples();
+	sort(sorted.begin(), sorted.end());
+
+	Result result;
+	result.name = name;
+	result.samples = sorted.size();
+	result.iterations = state.iterations();
+
+	if(sorted.empty()) {
+		result.median = result.p10 = result.p90 = result.min = result.mean = 0.0;
+		result.itemsPerSecond = 0.0;
+		return result;
+	}
+
+	double total = 0.0;
+
+	for(double sample : sorted)
+		total += sample;
+
+	result.median = percentile(sorted, 0.5);
+	result.p10 = percentile(sorted, 0.1);
+	result.p90 = percentile(sorted, 0.9);
+	result.min = sorted.front();
+	result.mean = total / sorted.size();
+	result.itemsPerSecond = result.median > 0.0 ?
+	state.items() * 1e9 / result.median : 0.0;
+
+	return result;
+}
+
+static bool writeJson(const string &path, const vector<Result> &results)
+{
+	ofstream file(path);
+
+	if(!file)
+		return false;
+
+	// one case per line, readBaseline() relies on it
+	file << "{\"benchmarks\": [\n";
+
+	for(size_t i = 0; i < results.size(); ++i) {
+		const Result &r = results[i];
+
+		file << "{\"name\": \"" << r.name << "\", \"median_ns\": " << r.median <<
+		", \"p10_ns\": " << r.p10 << ", \"p90_ns\": " << r.p90 <<
+		", \"min_ns\": " << r.min << ", \"mean_ns\": " << r.mean <<
+		", \"samples\": " << r.samples << ", \"iterations\": " << r.iterations <<
+		", \"items_per_second\": " << r.itemsPerSecond << "}" <<
+		(i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	file << "]}\n";
+
+	return bool(file);
+}
+
+// medians by name from a file written by writeJson()
+static bool readBaseline(const string &path, map<string, double> &medians)
+{
+	ifstream file(path);
+
+	if(!file)
+		return false;
+
+	string line;
+
+	while(getline(file, line)) {
+		size_t name = line.find("\"name\": \"");
+		size_t median = line.find("\"median_ns\": ");
+
+		if(name == string::npos || median == string::npos)
+			continue;
+
+		name += 9;
+		size_t end = line.find('"', name);
+
+		if(end != string::npos)
+			medians[line.substr(name, end - name)] = atof(line.c_str() + median + 13);
+	}
+
+	return true;
+}
+
+static string formatTime(double ns)
+{
+	char text[32];
+
+	if(ns >= 1e6)
+		snprintf(text, sizeof(text), "%.3f ms", ns * 1e-6);
+	else if(ns >= 1e3)
+		snprintf(text, sizeof(text), "%.3f us", ns * 1e-3);
+	else
+		snprintf(text, sizeof(text), "%.1f ns", ns);
+
+	return text;
+}
+
+static void usage()
+{
+	cout << "bench [--filter <text>] [--samples <n>] [--warmup <n>] "
+	"[--json <file>] [--baseline <file>] [--threshold <percent>] [--list]" <<
+	endl;
+}
+
+int main(int argc, char *argv[])
+{
+	string filter, jsonPath, baselinePath;
+	size_t samples = 15, warmup = 2;
+	double threshold = DEFAULT_THRESHOLD;
+
+	for(int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if(!strcmp(arg, "--list")) {
+			for(const Case &c : cases())
+				cout << c.name << endl;
+			return 0;
+		} else if(!value) {
+			usage();
+			return 2;
+		} else if(!strcmp(arg, "--filter")) {
+			filter = value;
+		} else if(!strcmp(arg, "--samples")) {
+			samples = max(1, atoi(value));
+		} else if(!strcmp(arg, "--warmup")) {
+			warmup = max(0, atoi(value));
+		} else if(!strcmp(arg, "--json")) {
+			jsonPath = value;
+		} else if(!strcmp(arg, "--baseline")) {
+			baselinePath = value;
+		} else if(!strcmp(arg, "--threshold")) {
+			threshold = atof(value);
+		} else {
+			usage();
+			return 2;
+		}
+
+		i++;
+	}
+
+	map<string, double> baseline;
+
+	if(baselinePath.size() && !readBaseline(baselinePath, baseline)) {
+		cerr << "Unable to read baseline " << baselinePath << endl;
+		return 2;
+	}
+
+	vector<Result> results;
+	size_t regressions = 0;
+
+	printf("%-28s %12s %12s %12s %12s %10s\n", "case", "median", "p10", "p90",
+	"items/s", baseline.size() ? "vs base" : "");
+
+	for(const Case &c : cases()) {
+		if(filter.size() && !strstr(c.name, filter.c_str()))
+			continue;
+
+		State state(samples, warmup, MIN_SAMPLE_SECONDS);
+		c.function(state);
+
+		Result result = summarize(c.name, state);
+		results.push_back(result);
+
+		string change;
+		auto base = baseline.find(c.name);
+
+		if(base != baseline.end() && base->second > 0.0) {
+			double percent = (result.median / base->second - 1.0) * 100.0;
+			char text[32];
+			snprintf(text, sizeof(text), "%+.1f%%%s", percent,
+			percent > threshold ? " !" : "");
+			change = text;
+
+			if(percent > threshold)
+				regressions++;
+		}
+
+		printf("%-28s %12s %12s %12s %12.4g %10s\n", c.name,
+		formatTime(result.median).c_str(), formatTime(result.p10).c_str(),
+		formatTime(result.p90).c_str(), result.itemsPerSecond, change.c_str());
+		fflush(stdout);
+	}
+
+	if(jsonPath.size() && !writeJson(jsonPath, results)) {
+		cerr << "Unable to write " << jsonPath << endl;
+		return 2;
+	}
+
+	if(regressions) {
+		printf("%zu case(s) more than %.1f%% slower than %s\n", regressions,
+		threshold, baselinePath.c_str());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace bench {
+	// Timing of one case. The case does its setup, then hands the code
+	// to time to measure(), which picks an iteration count that makes a
+	// sample last long enough to time, warms up and takes the samples.
+	class State {
+		public:
+			State(size_t samples, size_t warmup, double minSampleSeconds);
+
+			template <typename F>
+			void measure(const F &body);
+
+			// work items per iteration, for the items per second column
+			void setItems(size_t items);
+
+			// nanoseconds per iteration of every sample
+			const std::vector<double> &samples() const;
+			size_t iterations() const;
+			size_t items() const;
+
+		private:
+			size_t m_samples;
+			size_t m_warmup;
+			double m_minSampleSeconds;
+
+			size_t m_iterations = 0;
+			size_t m_items = 1;
+			std::vector<double> m_results;
+
+			template <typename F>
+			static double seconds(const F &body, size_t iterations);
+	};
+
+	typedef void (*Function)(State &state);
+
+	struct Registrar {
+		Registrar(const char *name, Function function);
+	};
+
+	// keep value, and the work producing it, from being optimized away
+	template <typename T>
+	inline void keep(const T &value)
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+	template <typename F>
+	double State::seconds(const F &body, size_t iterations)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		for(size_t i = 0; i < iterations; ++i)
+			body();
+
+		return std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	}
+
+	template <typename F>
+	void State::measure(const F &body)
+	{
+		// grow the iteration count until one sample is long enough
+		m_iterations = 1;
+
+		for(;;) {
+			double time = seconds(body, m_iterations);
+
+			if(time >= m_minSampleSeconds || m_iterations >= (1u << 30))
+				break;
+
+			double scale = time > 0.0 ? m_minSampleSeconds / time * 1.2 : 10.0;
+			m_iterations = std::max<size_t>(m_iterations + 1,
+			m_iterations * std::min(scale, 10.0));
+		}
+
+		for(size_t i = 0; i < m_warmup; ++i)
+			seconds(body, m_iterations);
+
+		m_results.clear();
+
+		for(size_t i = 0; i < m_samples; ++i)
+			m_results.push_back(seconds(body, m_iterations) * 1e9 / m_iterations);
+	}
+
+} // namespace bench
+
+// define and register a case, its body gets bench::State &state
+#define BENCH(name) \
+	static void bench_##name(bench::State &state); \
+	static bench::Registrar benchRegistrar_##name(#name, bench_##name); \
+	static void bench_##name(bench::State &state)
+
+#endif
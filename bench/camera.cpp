@@ -0,0 +1,43 @@
+#include "bench.h"
+
+#include <glm/glm.hpp>
+
+#include "opengl/camera.h"
+
+#define CAMERA_STEPS 1024
+
+// a moving camera, every step invalidates and rebuilds derived state
+BENCH(camera_update)
+{
+	Camera camera;
+	camera.setPerspective(60.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+
+	state.setItems(CAMERA_STEPS);
+	state.measure([&]() {
+		for(int i = 0; i < CAMERA_STEPS; ++i) {
+			camera.rotate(glm::vec3(0.1f, 0.3f, 0.0f));
+			camera.translate(glm::vec3(0.0f, 0.0f, 0.01f));
+
+			bench::keep(camera.viewProjection());
+			bench::keep(camera.inverseViewProjection());
+			bench::keep(camera.frustum());
+		}
+	});
+}
+
+// a still camera read by many systems in a frame
+BENCH(camera_cached)
+{
+	Camera camera;
+	camera.setPerspective(60.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	camera.setPosition(glm::vec3(1.0f, 2.0f, 3.0f));
+
+	state.setItems(CAMERA_STEPS);
+	state.measure([&]() {
+		for(int i = 0; i < CAMERA_STEPS; ++i) {
+			bench::keep(camera.viewProjection());
+			bench::keep(camera.frustum());
+			bench::keep(camera.corners());
+		}
+	});
+}
@@ -0,0 +1,61 @@
+#include "bench.h"
+
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include "opengl/sparse_vector.h"
+
+using namespace std;
+
+#define CHURN_ITEMS 4096
+#define CHURN_OPERATIONS 16384
+
+// Steady state of a pool: random slots are freed and refilled, as
+// entities come and go, with a walk over the live ones in between
+BENCH(sparse_vector_churn)
+{
+	sparse_vector<glm::mat4> pool;
+	vector<size_t> live;
+	vector<size_t> victims;
+
+	for(size_t i = 0; i < CHURN_ITEMS; ++i)
+		live.push_back(pool.insert(glm::mat4(1.0f)));
+
+	mt19937 random(7);
+
+	for(size_t i = 0; i < CHURN_OPERATIONS; ++i)
+		victims.push_back(random() % CHURN_ITEMS);
+
+	state.setItems(CHURN_OPERATIONS);
+	state.measure([&]() {
+		float sum = 0.0f;
+
+		for(size_t i = 0; i < victims.size(); ++i) {
+			size_t &slot = live[victims[i]];
+
+			pool.remove(slot);
+			slot = pool.insert(glm::mat4(float(i)));
+
+			if(i % 64 == 0)
+				sum += pool[live[i % CHURN_ITEMS]][0][0];
+		}
+
+		bench::keep(sum);
+	});
+}
+
+BENCH(sparse_vector_fill_clear)
+{
+	sparse_vector<glm::mat4> pool;
+
+	state.setItems(CHURN_ITEMS);
+	state.measure([&]() {
+		pool.clear();
+
+		for(size_t i = 0; i < CHURN_ITEMS; ++i)
+			pool.insert(glm::mat4(1.0f));
+
+		bench::keep(pool.size());
+	});
+}
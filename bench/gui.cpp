@@ -0,0 +1,30 @@
+#include "bench.h"
+
+#include "imgui/imgui.h"
+
+// Build a frame of the demo window without a platform or renderer
+// backend, this is the CPU cost ImGui adds to every interactive frame.
+BENCH(imgui_frame)
+{
+	ImGuiContext *context = ImGui::CreateContext();
+	ImGuiIO &io = ImGui::GetIO();
+
+	unsigned char *pixels;
+	int width, height;
+
+	io.IniFilename = nullptr;
+	io.DisplaySize = ImVec2(1280.0f, 720.0f);
+	io.DeltaTime = 1.0f / 60.0f;
+	io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+	io.Fonts->TexID = (ImTextureID)1;
+
+	state.measure([&]() {
+		ImGui::NewFrame();
+		ImGui::ShowDemoWindow();
+		ImGui::Render();
+
+		bench::keep(ImGui::GetDrawData()->TotalVtxCount);
+	});
+
+	ImGui::DestroyContext(context);
+}
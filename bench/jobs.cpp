@@ -0,0 +1,44 @@
+#include "bench.h"
+
+#include <cmath>
+
+#include "opengl/jobs.h"
+
+using namespace gl;
+using namespace std;
+
+#define JOBS 1024
+#define ELEMENTS (1 << 20)
+
+// scheduling overhead, empty jobs submitted and waited on
+BENCH(jobs_submit_wait)
+{
+	JobSystem jobs;
+	vector<JobHandle> handles;
+
+	state.setItems(JOBS);
+	state.measure([&]() {
+		handles.clear();
+
+		for(int i = 0; i < JOBS; ++i)
+			handles.push_back(jobs.submit([]() {}));
+
+		jobs.wait(handles);
+	});
+}
+
+BENCH(jobs_parallel_for)
+{
+	JobSystem jobs;
+	vector<float> values(ELEMENTS, 1.0f);
+
+	state.setItems(ELEMENTS);
+	state.measure([&]() {
+		jobs.parallelFor(0, values.size(), 4096, [&](size_t begin, size_t end) {
+			for(size_t i = begin; i < end; ++i)
+				values[i] = sqrt(values[i] + 1.0f);
+		});
+
+		bench::keep(values[0]);
+	});
+}
@@ -0,0 +1,140 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "opengl/opengl.h"
+#include "opengl/objparser.h"
+#include "opengl/welder.h"
+#include "opengl/meshcache.h"
+
+using namespace gl;
+using namespace std;
+
+// a wavy grid of GRID_SIZE^2 quads, about 8 MB of OBJ
+#define GRID_SIZE 256
+#define MODEL_PATH "bench_model.obj"
+
+// Written once into the working directory, with the cooked cache next
+// to it removed at exit. Every vertex is shared by up to six triangles,
+// so welding has real work to do.
+class ModelFile {
+	public:
+		ModelFile()
+		{
+			ofstream file(MODEL_PATH);
+			size_t n = GRID_SIZE + 1;
+
+			for(size_t y = 0; y < n; ++y) {
+				for(size_t x = 0; x < n; ++x) {
+					file << "v " << x << " " << (x * y % 7) * 0.1f << " " << y << "\n";
+				}
+			}
+
+			for(size_t y = 0; y < n; ++y) {
+				for(size_t x = 0; x < n; ++x)
+					file << "vt " << float(x) / GRID_SIZE << " " << float(y) / GRID_SIZE << "\n";
+			}
+
+			file << "vn 0 1 0\n";
+
+			for(size_t y = 0; y < GRID_SIZE; ++y) {
+				for(size_t x = 0; x < GRID_SIZE; ++x) {
+					size_t a = y * n + x + 1, b = a + 1, c = a + n, d = c + 1;
+
+					file << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 " <<
+					d << "/" << d << "/1 " << c << "/" << c << "/1\n";
+				}
+			}
+		}
+
+		~ModelFile()
+		{
+			remove(MODEL_PATH);
+			remove(CookedModel::pathFor(MODEL_PATH).c_str());
+		}
+};
+
+static const char *modelPath()
+{
+	static ModelFile file;
+	return MODEL_PATH;
+}
+
+BENCH(model_parse)
+{
+	const char *path = modelPath();
+
+	state.setItems(GRID_SIZE * GRID_SIZE);
+	state.measure([&]() {
+		ObjParser parser;
+		parser.parseFromFile(path);
+		bench::keep(parser.attrib().vertices.size());
+	});
+}
+
+// the same per index gather and weld as Model::read()
+BENCH(model_weld)
+{
+	ObjParser parser;
+	parser.parseFromFile(modelPath());
+
+	const tinyobj::attrib_t &attrib = parser.attrib();
+	const tinyobj::mesh_t &mesh = parser.shapes()[0].mesh;
+
+	state.setItems(mesh.indices.size());
+	state.measure([&]() {
+		VertexWelder welder;
+		welder.reserve(mesh.indices.size(), attrib.vertices.size() / 3);
+
+		for(const tinyobj::index_t &idx : mesh.indices) {
+			Vertex vertex;
+
+			vertex.pos = {attrib.vertices[3*idx.vertex_index+0],
+			attrib.vertices[3*idx.vertex_index+1],
+			attrib.vertices[3*idx.vertex_index+2]};
+
+			vertex.normal = {attrib.normals[3*idx.normal_index+0],
+			attrib.normals[3*idx.normal_index+1],
+			attrib.normals[3*idx.normal_index+2]};
+
+			vertex.color = {attrib.colors[3*idx.vertex_index+0],
+			attrib.colors[3*idx.vertex_index+1],
+			attrib.colors[3*idx.vertex_index+2]};
+
+			vertex.texCoords = {attrib.texcoords[2*idx.texcoord_index+0],
+			attrib.texcoords[2*idx.texcoord_index+1]};
+
+			bench::keep(welder.insert(vertex));
+		}
+	});
+}
+
+// parse, weld and cook, the cache is dropped before every read
+BENCH(model_read)
+{
+	const char *path = modelPath();
+	string cooked = CookedModel::pathFor(path);
+
+	state.setItems(GRID_SIZE * GRID_SIZE);
+	state.measure([&]() {
+		remove(cooked.c_str());
+
+		ModelData data;
+		bench::keep(Model::read(path, 0.0f, data));
+	});
+}
+
+BENCH(model_read_cooked)
+{
+	const char *path = modelPath();
+	ModelData warm;
+
+	Model::read(path, 0.0f, warm);
+
+	state.setItems(GRID_SIZE * GRID_SIZE);
+	state.measure([&]() {
+		ModelData data;
+		bench::keep(Model::read(path, 0.0f, data));
+	});
+}
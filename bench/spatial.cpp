@@ -0,0 +1,182 @@
+#include "bench.h"
+
+#include <random>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "opengl/volumes.h"
+#include "opengl/culling.h"
+
+using namespace gl;
+using namespace std;
+
+#define WORLD_SIZE 100.0f
+#define TREE_ITEMS 10000
+#define TREE_BIN_SIZE 16
+#define TREE_DEPTH 8
+#define QUERIES 256
+#define INTERSECTIONS 4096
+#define INSTANCES 16384
+
+// small boxes spread over the world cube, same for every run
+static vector<Volume> boxes(size_t count, unsigned int seed)
+{
+	mt19937 random(seed);
+	uniform_real_distribution<float> position(-WORLD_SIZE, WORLD_SIZE);
+	uniform_real_distribution<float> size(0.1f, 2.0f);
+
+	vector<Volume> volumes;
+	volumes.reserve(count);
+
+	for(size_t i = 0; i < count; ++i) {
+		glm::vec3 min(position(random), position(random), position(random));
+		volumes.push_back(Volume(min, min + glm::vec3(size(random))));
+	}
+
+	return volumes;
+}
+
+static Volume world()
+{
+	return Volume(glm::vec3(-WORLD_SIZE - 2.0f), glm::vec3(WORLD_SIZE + 2.0f));
+}
+
+static Frustum frustum()
+{
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f,
+	0.1f, 2.0f * WORLD_SIZE);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -WORLD_SIZE),
+	glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	return Frustum(projection * view);
+}
+
+BENCH(octree_insert)
+{
+	vector<Volume> volumes = boxes(TREE_ITEMS, 1);
+
+	state.setItems(volumes.size());
+	state.measure([&]() {
+		Octree tree(world(), TREE_BIN_SIZE, TREE_DEPTH);
+
+		for(size_t i = 0; i < volumes.size(); ++i)
+			tree.insert(i, volumes[i]);
+
+		bench::keep(tree);
+	});
+}
+
+BENCH(octree_update)
+{
+	vector<Volume> volumes = boxes(TREE_ITEMS, 1);
+	Octree tree(world(), TREE_BIN_SIZE, TREE_DEPTH);
+
+	for(size_t i = 0; i < volumes.size(); ++i)
+		tree.insert(i, volumes[i]);
+
+	// every item moves a little back and forth, as a simulation would
+	float step = 0.25f;
+
+	state.setItems(volumes.size());
+	state.measure([&]() {
+		step = -step;
+
+		for(size_t i = 0; i < volumes.size(); ++i) {
+			volumes[i] = volumes[i].translated(glm::vec3(step, 0.0f, step));
+			tree.update(i, volumes[i]);
+		}
+	});
+}
+
+BENCH(octree_query)
+{
+	vector<Volume> volumes = boxes(TREE_ITEMS, 1);
+	vector<Volume> queries = boxes(QUERIES, 2);
+	Octree tree(world(), TREE_BIN_SIZE, TREE_DEPTH);
+
+	for(size_t i = 0; i < volumes.size(); ++i)
+		tree.insert(i, volumes[i]);
+
+	// query regions of about a tenth of the world
+	for(Volume &query : queries)
+		query.max = query.min + glm::vec3(WORLD_SIZE * 0.2f);
+
+	state.setItems(queries.size());
+	state.measure([&]() {
+		size_t found = 0;
+
+		for(const Volume &query : queries)
+			found += tree.neighbors(query).size();
+
+		bench::keep(found);
+	});
+}
+
+BENCH(volume_intersect)
+{
+	vector<Volume> a = boxes(INTERSECTIONS, 3);
+	vector<Volume> b = boxes(INTERSECTIONS, 4);
+
+	// grow the second set so about half of the pairs overlap
+	for(Volume &volume : b) {
+		volume.min -= glm::vec3(WORLD_SIZE * 0.5f);
+		volume.max += glm::vec3(WORLD_SIZE * 0.5f);
+	}
+
+	state.setItems(a.size());
+	state.measure([&]() {
+		size_t hits = 0;
+
+		for(size_t i = 0; i < a.size(); ++i)
+			hits += a[i].intersect(b[i]);
+
+		bench::keep(hits);
+	});
+}
+
+BENCH(frustum_intersect)
+{
+	vector<Volume> volumes = boxes(INTERSECTIONS, 5);
+	Frustum view = frustum();
+
+	state.setItems(volumes.size());
+	state.measure([&]() {
+		size_t hits = 0;
+
+		for(const Volume &volume : volumes)
+			hits += view.intersect(volume);
+
+		bench::keep(hits);
+	});
+}
+
+BENCH(instance_cull)
+{
+	vector<Volume> volumes = boxes(INSTANCES, 6);
+	vector<glm::mat4> instances, visible(INSTANCES);
+	Volume local(glm::vec3(-0.5f), glm::vec3(0.5f));
+	Frustum view = frustum();
+	InstanceCuller culler;
+
+	for(const Volume &volume : volumes)
+		instances.push_back(glm::translate(glm::mat4(1.0f), volume.min));
+
+	state.setItems(instances.size());
+	state.measure([&]() {
+		bench::keep(culler.cull(instances.data(), instances.size(), local, view,
+		visible.data()));
+	});
+}
+
+BENCH(octree_rebuild)
+{
+	vector<Volume> volumes = boxes(TREE_ITEMS, 1);
+	Octree tree(world(), TREE_BIN_SIZE, TREE_DEPTH);
+
+	state.setItems(volumes.size());
+	state.measure([&]() {
+		tree.rebuild(volumes);
+		bench::keep(tree);
+	});
+}
@@ -0,0 +1,95 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#include "opengl/framebuffer.h"
+#include "opengl/texture_cooker.h"
+
+using namespace gl;
+using namespace std;
+
+// a texture set of a large scene, written once into the working directory
+#define TEXTURE_COUNT 200
+#define TEXTURE_SIZE 256
+#define TEXTURE_PREFIX "bench_texture_"
+
+// as in TextureCache::acquireBatch()
+#define BATCH_IMAGES_PER_THREAD 2
+
+// Gradients with a per image pattern, removed at exit. Read without
+// compression, so no cooked copies are written and every run decodes.
+class TextureFiles {
+	public:
+		TextureFiles()
+		{
+			vector<unsigned char> rgba(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+
+			for(int i = 0; i < TEXTURE_COUNT; ++i) {
+				for(int y = 0; y < TEXTURE_SIZE; ++y) {
+					for(int x = 0; x < TEXTURE_SIZE; ++x) {
+						unsigned char *p = &rgba[(y * TEXTURE_SIZE + x) * 4];
+
+						p[0] = x;
+						p[1] = y;
+						p[2] = (x ^ y) * (i + 1);
+						p[3] = 255;
+					}
+				}
+
+				paths.push_back(TEXTURE_PREFIX + to_string(i) + ".png");
+				writePng(paths.back(), rgba.data(), TEXTURE_SIZE, TEXTURE_SIZE);
+			}
+		}
+
+		~TextureFiles()
+		{
+			for(const string &path : paths)
+				remove(path.c_str());
+		}
+
+		vector<string> paths;
+};
+
+static const vector<string> &texturePaths()
+{
+	static TextureFiles files;
+	return files.paths;
+}
+
+// one image after another, only the mips of each image run in parallel
+BENCH(texture_read_serial)
+{
+	const vector<string> &paths = texturePaths();
+
+	state.setItems(paths.size());
+	state.measure([&]() {
+		for(const string &path : paths) {
+			TextureData data;
+			readTexture(path, false, data);
+			bench::keep(data.levels.size());
+		}
+	});
+}
+
+// a few images per thread at once, in the groups
+// TextureCache::acquireBatch() reads them in
+BENCH(texture_read_batch)
+{
+	const vector<string> &paths = texturePaths();
+	size_t group = std::max(1u, thread::hardware_concurrency()) *
+	BATCH_IMAGES_PER_THREAD;
+
+	state.setItems(paths.size());
+	state.measure([&]() {
+		for(size_t first = 0; first < paths.size(); first += group) {
+			vector<string> batch(paths.begin() + first,
+			paths.begin() + std::min(paths.size(), first + group));
+			vector<unique_ptr<TextureData>> data;
+
+			readTextures(batch, false, data);
+			bench::keep(data.size());
+		}
+	});
+}
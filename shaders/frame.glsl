@@ -0,0 +1,10 @@
+// per frame values shared by every program, bound once per frame, see
+// FrameUniforms in opengl.h
+layout (std140) uniform Frame {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+	float deltaTime;
+};
@@ -1,16 +1,22 @@
 #version 330 core
 
+#ifndef WIREFRAME
 in vec3 vColor;
 in vec3 vNormal;
 in vec2 vTexCoords;
 
 uniform sampler2D texture_diffuse1;
+#endif
 
 out vec4 FragColor;  
   
 void main()
 {
+#ifdef WIREFRAME
+	FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+#else
 	vec3 lightDir = vec3(0.0, 0.0, 1.0);
 	float intensity = max(dot(vNormal, lightDir), 0.0);
 	FragColor = vec4(intensity * vColor * texture(texture_diffuse1, vTexCoords).xyz, 1.0);
+#endif
 }
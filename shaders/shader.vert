@@ -4,22 +4,26 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 color; // the color variable has attribute position 1
 layout (location = 3) in vec2 texCoords; 
 layout (location = 4) in mat4 model;
-  
+layout (location = 8) in mat3 normalMatrix; // transpose(inverse(mat3(model)))
+
+#include "frame.glsl"
+
+// WIREFRAME: position only, for the black overlay
+#ifndef WIREFRAME
 out vec3 vColor; // output a color to the fragment shader
 out vec3 vNormal;
 out vec2 vTexCoords;
-
-//uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-//uniform mat4 mvp;
-//uniform mat3 normalMatrix;
+#endif
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(position, 1.0);
-	vNormal = mat3(transpose(inverse(view * model))) * normal;
+	gl_Position = viewProjection * model * vec4(position, 1.0);
+
+#ifndef WIREFRAME
+	// per instance from the CPU, the view is rigid so mat3(view) is its
+	// own normal matrix
+	vNormal = mat3(view) * normalMatrix * normal;
 	vColor = color; // set ourColor to the input color we got from the vertex data
 	vTexCoords = texCoords;
+#endif
 }
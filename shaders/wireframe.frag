@@ -1,9 +0,0 @@
-#version 330 core
-
-out vec4 FragColor;  
-  
-void main()
-{
-	vec3 color = vec3(0.0, 0.0, 0.0);	
-	FragColor = vec4(color, 1.0);
-}
@@ -4,11 +4,21 @@
 using namespace gl;
 using namespace glm;
 
-Application::Application()
+Application::Application(const WindowOptions &options) :
+OpenGLWindow(options)
 {
 	setTitle("Application");
 
-    ImGui::Init(sdlWindow(), context());
+	// both compile in the background while the first frames run, get()
+	// hands them out once linked
+	m_shader = shaders()->request("shaders/shader.vert",
+	"shaders/shader.frag");
+	m_wireframe = shaders()->request("shaders/shader.vert",
+	"shaders/shader.frag", {"WIREFRAME"});
+
+	// the ImGui backend needs an SDL window
+	if(!headless())
+		ImGui::Init(sdlWindow(), context());
 }
 
 Application::~Application()
@@ -18,14 +28,22 @@ Application::~Application()
 
 void Application::update(float dt)
 {
+	if(headless())
+		return;
+
 	ImGui::RenderFrame(sdlWindow(), [&](){
 		ImGui::ShowDemoWindow();
+		ImGui::ProfilerWindow(profiler());
 	});
+
+	if(ImGui::WantsRedraw())
+		requestRedraw();
 }
 
 void Application::processEvent(const SDL_Event &event)
 {
-	ImGui::ProcessEvent(event);
+	if(!headless())
+		ImGui::ProcessEvent(event);
 }
 
 void Application::sizeChanged(int w, int h)
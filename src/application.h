@@ -2,16 +2,22 @@
 #define APPLICATION_H
 
 #include "opengl/opengl.h"
+#include "opengl/shader_library.h"
 
 class Application : public gl::OpenGLWindow {
 	public:
-		Application();
+		Application(const gl::WindowOptions &options = gl::WindowOptions());
 		~Application();
 
 	protected:
 		void update(float dt) override;
 		void processEvent(const SDL_Event &event) override;
         void sizeChanged(int w, int h) override;
+
+	private:
+		// shaded and wireframe overlay variants of shaders/shader.*
+		gl::ShaderHandle m_shader = 0;
+		gl::ShaderHandle m_wireframe = 0;
 };
 
 #endif
@@ -1,4 +1,8 @@
 #include "myimgui.h"
+#include "../opengl/profiler.h"
+
+#include <cstdio>
+#include <string>
 
 void ImGui::Init(SDL_Window *window, const SDL_GLContext &context)
 {
@@ -23,3 +27,123 @@ void ImGui::ProcessEvent(const SDL_Event &event)
 {
 	ImGui_ImplSDL2_ProcessEvent(&event);
 }
+
+bool ImGui::WantsRedraw()
+{
+	ImGuiIO &io = ImGui::GetIO();
+
+	return ImGui::IsAnyMouseDown() || ImGui::IsAnyItemActive() ||
+	io.WantTextInput;
+}
+
+static ImU32 scopeColor(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	for(; *name; name++)
+		hash = (hash ^ (unsigned char)*name) * 16777619u;
+
+	return ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.8f);
+}
+
+static void flameView(const gl::Profiler &profiler)
+{
+	const std::vector<gl::ProfileEvent> &events = profiler.lastFrame();
+	double frameStart = profiler.lastFrameStart();
+	double frameDuration = profiler.lastFrameDuration();
+
+	int depth = 0;
+
+	for(const gl::ProfileEvent &event : events) {
+		if(event.thread == profiler.mainThread() && event.depth > depth)
+			depth = event.depth;
+	}
+
+	// main thread rows, then one row for the GPU
+	const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImVec2 size(ImGui::GetContentRegionAvail().x, rowHeight * (depth + 2));
+
+	ImGui::Dummy(size);
+
+	if(frameDuration <= 0.0)
+		return;
+
+	ImDrawList *draw = ImGui::GetWindowDrawList();
+	draw->PushClipRect(origin, ImVec2(origin.x + size.x, origin.y + size.y),
+	true);
+
+	float scale = size.x / frameDuration;
+
+	for(const gl::ProfileEvent &event : events) {
+		bool gpu = event.thread == gl::Profiler::GPU_THREAD;
+
+		if(!gpu && event.thread != profiler.mainThread())
+			continue;
+
+		// GPU work lags a frame, it is drawn from the frame start
+		float x0 = gpu ? 0.0f : (event.start - frameStart) * scale;
+		float x1 = x0 + event.duration * scale;
+		float y0 = rowHeight * (gpu ? depth + 1 : event.depth);
+
+		ImVec2 min(origin.x + x0, origin.y + y0);
+		ImVec2 max(origin.x + x1, origin.y + y0 + rowHeight - 1.0f);
+
+		if(max.x - min.x < 1.0f)
+			max.x = min.x + 1.0f;
+
+		draw->AddRectFilled(min, max, scopeColor(event.name));
+		draw->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32_BLACK, event.name);
+
+		if(ImGui::IsMouseHoveringRect(min, max))
+			ImGui::SetTooltip("%s%s %.3f ms", gpu ? "GPU " : "", event.name,
+			event.duration * 0.001);
+	}
+
+	draw->PopClipRect();
+}
+
+void ImGui::ProfilerWindow(gl::Profiler &profiler, bool *open)
+{
+	static std::string traceStatus;
+
+	if(!ImGui::Begin("Profiler", open)) {
+		ImGui::End();
+		return;
+	}
+
+	bool enabled = profiler.enabled();
+
+	if(ImGui::Checkbox("Enabled", &enabled))
+		profiler.setEnabled(enabled);
+
+	ImGui::SameLine();
+
+	if(ImGui::Button("Save trace")) {
+		traceStatus = profiler.writeTrace("trace.json") ?
+		"wrote trace.json" : "unable to write trace.json";
+	}
+
+	ImGui::SameLine();
+	ImGui::TextUnformatted(traceStatus.c_str());
+
+	ImGui::Text("frame %.3f ms", profiler.lastFrameDuration() * 0.001);
+
+	flameView(profiler);
+
+	// oldest value first
+	int offset = (profiler.historyHead() + 1) % PROFILE_HISTORY;
+	char overlay[128];
+
+	for(const gl::ProfileScopeStats &scope : profiler.scopes()) {
+		snprintf(overlay, sizeof(overlay), "%s%s %.3f ms",
+		scope.gpu ? "GPU " : "", scope.name, scope.average);
+
+		ImGui::PushID(&scope);
+		ImGui::PlotLines("", scope.history, PROFILE_HISTORY, offset, overlay,
+		0.0f, FLT_MAX, ImVec2(-1.0f, 40.0f));
+		ImGui::PopID();
+	}
+
+	ImGui::End();
+}
@@ -9,6 +9,10 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 
+namespace gl {
+	class Profiler;
+}
+
 namespace ImGui {
 	template <typename F>
 	bool InputTextCool(const char* label, std::string* str,
@@ -27,6 +31,15 @@ namespace ImGui {
 
 	void Init(SDL_Window *window, const SDL_GLContext &context);
 
+	// whether ImGui still changes without new input: held buttons, an
+	// active widget such as a blinking text cursor, or a drag. For lazy
+	// redraw, call after RenderFrame()
+	bool WantsRedraw();
+
+	// window with a flame view of the last frame, per scope graphs and
+	// trace export
+	void ProfilerWindow(gl::Profiler &profiler, bool *open = nullptr);
+
 	template<typename F>
 	void Init(SDL_Window *window, const SDL_GLContext &context,
 		const F &initFunction)
@@ -1,8 +1,47 @@
 #include "application.h"
 
+#include <cstring>
+#include <cstdlib>
+
+// --headless, --frames <n>, --size <w>x<h>, --dump <directory>,
+// --stats <file.json>, --simulation-thread, --lazy
+static gl::WindowOptions parseOptions(int argc, char *argv[])
+{
+	gl::WindowOptions options;
+
+	for(int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if(!strcmp(arg, "--headless")) {
+			options.headless = true;
+		} else if(!strcmp(arg, "--lazy")) {
+			options.lazyRedraw = true;
+		} else if(!strcmp(arg, "--simulation-thread")) {
+			options.simulationThread = true;
+		} else if(!strcmp(arg, "--frames") && value) {
+			options.frames = strtoull(value, nullptr, 10);
+			i++;
+		} else if(!strcmp(arg, "--size") && value) {
+			sscanf(value, "%dx%d", &options.width, &options.height);
+			i++;
+		} else if(!strcmp(arg, "--dump") && value) {
+			options.dumpFrames = value;
+			i++;
+		} else if(!strcmp(arg, "--stats") && value) {
+			options.statsPath = value;
+			i++;
+		} else {
+			printf("Unknown option %s\n", arg);
+		}
+	}
+
+	return options;
+}
+
 int main(int argc, char *argv[])
 {  
-	Application app;
+	Application app(parseOptions(argc, argv));
     app.run();
 
 	return 0;
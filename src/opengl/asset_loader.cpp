@@ -0,0 +1,394 @@
+#include "asset_loader.h"
+#include "texture_atlas.h"
+#include "image_decoder.h"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace gl;
+using namespace std;
+
+// smallest slice worth issuing, also what an exhausted budget still gets
+#define MIN_SLICE (64 * 1024)
+
+AssetLoader::AssetLoader(size_t workers)
+{
+	if(!workers) {
+		size_t threads = thread::hardware_concurrency();
+		workers = threads > 1 ? threads - 1 : 1;
+	}
+
+	for(size_t i = 0; i < workers; ++i)
+		m_workers.emplace_back(&AssetLoader::work, this);
+}
+
+AssetLoader::AssetLoader(JobSystem &jobs) : m_jobSystem(&jobs)
+{
+
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+		m_jobs.clear();
+	}
+
+	m_wake.notify_all();
+
+	for(thread &worker : m_workers)
+		worker.join();
+
+	// reads not started yet return at once
+	if(m_jobSystem)
+		m_jobSystem->wait(m_running);
+
+	// drop unfinished uploads, the context is still current
+	for(auto &ready : m_readyTextures)
+		m_textures.push_back(ready);
+
+	for(auto &ready : m_readyModels)
+		m_models.push_back(ready);
+
+	for(auto &upload : m_textures) {
+		if(upload->id)
+			glState().deleteTextures(1, &upload->id);
+	}
+
+	for(auto &upload : m_models) {
+		if(upload->current)
+			upload->current->cleanup();
+	}
+
+	if(m_pbo)
+		glState().deleteBuffers(1, &m_pbo);
+}
+
+void AssetLoader::setBudget(size_t bytes, unsigned int microseconds)
+{
+	m_budgetBytes = bytes;
+	m_budgetMicros = microseconds;
+}
+
+Texture AssetLoader::loadTexture(const char *path, const char *type)
+{
+	TextureCache &cache = textureCache();
+
+	bool created;
+	TextureHandle handle = cache.acquireAsync(path, created);
+
+	if(created) {
+		auto upload = make_shared<TextureUpload>();
+		upload->handle = handle;
+		upload->path = path;
+		upload->compress = compressedTexturesSupported();
+
+		m_requested++;
+
+		submit([this, upload]() {
+			upload->data.reset(new TextureData);
+			upload->ok = readTexture(upload->path, upload->compress, *upload->data);
+
+			if(!upload->ok)
+				cerr << "Unable to load texture: " << upload->path << endl;
+
+			lock_guard<mutex> lock(m_mutex);
+			m_readyTextures.push_back(upload);
+		});
+	}
+
+	return Texture(cache.glId(handle), type, cache.path(handle), handle);
+}
+
+void AssetLoader::loadModel(Model &model, const string &path, float weldEpsilon,
+bool keepCpuData)
+{
+	auto upload = make_shared<ModelUpload>();
+	upload->model = &model;
+	upload->path = path;
+	upload->weldEpsilon = weldEpsilon;
+	upload->keepCpuData = keepCpuData;
+	upload->atlas = m_atlas;
+
+	m_requested++;
+
+	submit([this, upload]() {
+		upload->data.reset(new ModelData);
+		upload->ok = Model::read(upload->path, upload->weldEpsilon, *upload->data);
+
+		lock_guard<mutex> lock(m_mutex);
+		m_readyModels.push_back(upload);
+	});
+}
+
+void AssetLoader::setAtlas(TextureAtlas *atlas)
+{
+	m_atlas = atlas;
+}
+
+void AssetLoader::pump()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+
+		m_textures.insert(m_textures.end(), m_readyTextures.begin(),
+		m_readyTextures.end());
+		m_models.insert(m_models.end(), m_readyModels.begin(),
+		m_readyModels.end());
+
+		m_readyTextures.clear();
+		m_readyModels.clear();
+	}
+
+	auto start = chrono::steady_clock::now();
+	size_t completed = m_completed;
+	size_t sent = 0;
+	bool first = true;
+
+	while(m_textures.size() || m_models.size()) {
+		if(!first) {
+			auto elapsed = chrono::duration_cast<chrono::microseconds>(
+			chrono::steady_clock::now() - start).count();
+
+			if(sent >= m_budgetBytes || elapsed >= m_budgetMicros)
+				break;
+		}
+
+		first = false;
+
+		size_t allowance = std::max<size_t>(MIN_SLICE,
+		m_budgetBytes > sent ? m_budgetBytes - sent : 0);
+		bool done;
+
+		// textures first, they replace visible placeholders
+		if(m_textures.size()) {
+			sent += uploadSlice(*m_textures.front(), allowance, done);
+
+			if(done) {
+				m_textures.pop_front();
+				m_completed++;
+			}
+		} else {
+			sent += uploadSlice(*m_models.front(), allowance, done);
+
+			if(done) {
+				m_models.pop_front();
+				m_completed++;
+			}
+		}
+	}
+
+	// idle until the next request, keep no decode buffers until then
+	if(m_completed != completed && !pending())
+		trimDecodePool();
+}
+
+size_t AssetLoader::pending() const
+{
+	return m_requested - m_completed;
+}
+
+void AssetLoader::work()
+{
+	for(;;) {
+		function<void()> job;
+
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_stop || m_jobs.size(); });
+
+			if(m_stop)
+				return;
+
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+void AssetLoader::submit(function<void()> job)
+{
+	if(m_jobSystem) {
+		// forget finished reads, submit() runs on the GL thread only
+		m_running.erase(remove_if(m_running.begin(), m_running.end(),
+		[this](const JobHandle &read) { return m_jobSystem->done(read); }),
+		m_running.end());
+
+		m_running.push_back(m_jobSystem->submitBackground([this, job]() {
+			{
+				lock_guard<mutex> lock(m_mutex);
+
+				if(m_stop)
+					return;
+			}
+
+			job();
+		}));
+
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(job));
+	}
+
+	m_wake.notify_one();
+}
+
+size_t AssetLoader::uploadSlice(TextureUpload &upload, size_t bytes, bool &done)
+{
+	done = false;
+
+	// reading failed, the placeholder stays
+	if(!upload.ok) {
+		done = true;
+		return 0;
+	}
+
+	const TextureData &data = *upload.data;
+
+	if(!upload.id)
+		upload.id = allocateTexture(data);
+
+	if(!m_pbo)
+		glGenBuffers(1, &m_pbo);
+
+	// whole rows, or rows of blocks, that fit the allowance
+	int alignment = textureRowAlignment(data);
+	size_t rowBytes = textureRowBytes(data, upload.level);
+	int rows = std::max<size_t>(1, bytes / rowBytes) * alignment;
+
+	size_t size = uploadTextureRows(upload.id, data, upload.level, upload.rows,
+	rows, m_pbo);
+
+	upload.rows += rows;
+
+	frameStats().bytesUploaded += size;
+	frameStats().uploads++;
+
+	if(upload.rows >= data.levels[upload.level].height) {
+		upload.level++;
+		upload.rows = 0;
+	}
+
+	if(upload.level == data.levels.size()) {
+		if(!textureCache().resolve(upload.handle, upload.path.c_str(), upload.id,
+		data.bytes()))
+			glState().deleteTextures(1, &upload.id);
+
+		upload.data.reset();
+		upload.id = 0;
+		done = true;
+	}
+
+	return size;
+}
+
+size_t AssetLoader::uploadSlice(ModelUpload &upload, size_t bytes, bool &done)
+{
+	done = false;
+
+	if(!upload.ok) {
+		cerr << "Unable to load model from " << upload.path << endl;
+		done = true;
+		return 0;
+	}
+
+	const vector<CookedModel::MeshView> &meshes = upload.data->meshes;
+
+	if(upload.mesh == meshes.size()) {
+		done = true;
+		return 0;
+	}
+
+	const CookedModel::MeshView &view = meshes[upload.mesh];
+
+	if(!upload.current) {
+		vector<Texture> textures;
+		vector<SubMesh> submeshes;
+		vector<AtlasHandle> handles;
+
+		// small textures go onto the atlas pages, the mesh then uploads
+		// from a copy with remapped texture coordinates
+		if(upload.atlas) {
+			upload.atlas->pack(view.materials, view.vertices, view.vertexCount,
+			view.indices, view.indexCount, handles, upload.packedVertices,
+			upload.packedIndices);
+		}
+
+		Model::createMaterials(view.materials, textures, submeshes, this,
+		upload.atlas, &handles);
+
+		size_t vertexCount = upload.packedVertices.size() ?
+		upload.packedVertices.size() : view.vertexCount;
+		size_t indexCount = upload.packedIndices.size() ?
+		upload.packedIndices.size() : view.indexCount;
+
+		upload.current.reset(new Mesh(vertexCount, indexCount, textures,
+		view.volume, view.sphere));
+		upload.current->submeshes = submeshes;
+	}
+
+	const Vertex *vertices = view.vertices;
+	size_t vertexCount = view.vertexCount;
+	const unsigned int *indices = view.indices;
+	size_t indexCount = view.indexCount;
+
+	if(upload.packedVertices.size()) {
+		vertices = upload.packedVertices.data();
+		vertexCount = upload.packedVertices.size();
+		indices = upload.packedIndices.data();
+		indexCount = upload.packedIndices.size();
+	}
+
+	size_t sent = 0;
+
+	if(upload.vertices < vertexCount) {
+		size_t count = std::min(vertexCount - upload.vertices,
+		std::max<size_t>(1, bytes / sizeof(Vertex)));
+
+		upload.current->uploadVertices(vertices + upload.vertices,
+		upload.vertices, count);
+
+		upload.vertices += count;
+		sent = count * sizeof(Vertex);
+	} else if(upload.indices < indexCount) {
+		size_t count = std::min(indexCount - upload.indices,
+		std::max<size_t>(1, bytes / sizeof(unsigned int)));
+
+		upload.current->uploadIndices(indices + upload.indices,
+		upload.indices, count);
+
+		upload.indices += count;
+		sent = count * sizeof(unsigned int);
+	}
+
+	if(upload.vertices == vertexCount && upload.indices == indexCount) {
+		if(upload.keepCpuData) {
+			upload.current->keepCpuData(vertices, vertexCount, indices,
+			indexCount);
+		}
+
+		upload.model->meshes.push_back(*upload.current);
+		upload.current.reset();
+		upload.packedVertices = vector<Vertex>();
+		upload.packedIndices = vector<unsigned int>();
+
+		upload.mesh++;
+		upload.vertices = 0;
+		upload.indices = 0;
+
+		// release the mapping or parsed data with the last mesh
+		if(upload.mesh == meshes.size()) {
+			upload.data.reset();
+			done = true;
+		}
+	}
+
+	return sent;
+}
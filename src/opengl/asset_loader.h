@@ -0,0 +1,130 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "opengl.h"
+#include "meshcache.h"
+#include "texture_cooker.h"
+#include "jobs.h"
+
+namespace gl {
+	// Background loading of textures and models. Worker threads read
+	// textures (cooked cache, or decode, mip and compress) and models
+	// (cooked cache, or parse, weld and cook), the GL thread then uploads
+	// the results in pump(), at most the budget of bytes or microseconds
+	// per call. Textures show the texture cache placeholder until
+	// uploaded, model meshes appear one by one once their buffers are
+	// filled.
+	class AssetLoader {
+		public:
+			// 0 workers picks one per hardware thread, minus the GL thread
+			AssetLoader(size_t workers = 0);
+
+			// no threads of its own, reads run as background jobs of jobs
+			AssetLoader(JobSystem &jobs);
+			~AssetLoader();
+
+			AssetLoader(const AssetLoader &) = delete;
+			AssetLoader &operator=(const AssetLoader &) = delete;
+
+			// limits of a single pump(), the first slice always runs so
+			// every call makes progress
+			void setBudget(size_t bytes, unsigned int microseconds);
+
+			// returns at once, the texture holds a cache reference
+			Texture loadTexture(const char *path, const char *type);
+
+			// meshes are appended to model as they finish uploading, model
+			// must stay alive until pending() drops to zero. keepCpuData
+			// as for Model
+			void loadModel(Model &model, const std::string &path,
+			float weldEpsilon = 0.0f, bool keepCpuData = false);
+
+			// small model textures go onto atlas from then on, nullptr for
+			// a texture each. Atlas images are decoded and packed in pump()
+			void setAtlas(TextureAtlas *atlas);
+
+			// upload finished work, GL thread only, once per frame
+			void pump();
+
+			// loads requested and not yet fully uploaded
+			size_t pending() const;
+
+		private:
+			struct TextureUpload {
+				TextureHandle handle;
+				std::string path;
+				bool compress;
+				std::unique_ptr<TextureData> data;
+				bool ok = false;
+
+				unsigned int id = 0;
+				size_t level = 0; // level being uploaded
+				int rows = 0; // rows of it uploaded so far
+			};
+
+			struct ModelUpload {
+				Model *model;
+				std::string path;
+				float weldEpsilon;
+				bool keepCpuData;
+				TextureAtlas *atlas;
+				std::unique_ptr<ModelData> data;
+				bool ok = false;
+
+				size_t mesh = 0; // mesh being uploaded
+				size_t vertices = 0, indices = 0; // elements uploaded so far
+				std::unique_ptr<Mesh> current;
+
+				// current mesh remapped onto the atlas, empty when not
+				std::vector<Vertex> packedVertices;
+				std::vector<unsigned int> packedIndices;
+			};
+
+			void work();
+			void submit(std::function<void()> job);
+
+			// upload one slice of at most bytes, returns bytes sent and
+			// sets done once the item is complete
+			size_t uploadSlice(TextureUpload &upload, size_t bytes, bool &done);
+			size_t uploadSlice(ModelUpload &upload, size_t bytes, bool &done);
+
+			std::vector<std::thread> m_workers;
+			std::deque<std::function<void()>> m_jobs;
+			bool m_stop = false;
+
+			// when loading on a job system, reads not yet finished
+			JobSystem *m_jobSystem = nullptr;
+			TextureAtlas *m_atlas = nullptr;
+			std::vector<JobHandle> m_running;
+
+			// finished by workers, guarded by m_mutex
+			std::deque<std::shared_ptr<TextureUpload>> m_readyTextures;
+			std::deque<std::shared_ptr<ModelUpload>> m_readyModels;
+
+			mutable std::mutex m_mutex;
+			std::condition_variable m_wake;
+
+			// GL thread only
+			std::deque<std::shared_ptr<TextureUpload>> m_textures;
+			std::deque<std::shared_ptr<ModelUpload>> m_models;
+			unsigned int m_pbo = 0;
+
+			size_t m_budgetBytes = 4 * 1024 * 1024;
+			unsigned int m_budgetMicros = 2000;
+
+			size_t m_requested = 0; // GL thread only
+			size_t m_completed = 0;
+	};
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,209 @@
+#include "bounds.h"
+#include "parallel.h"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BOUNDS_SSE
+#endif
+
+using namespace gl;
+using namespace glm;
+
+// below this many boxes per thread spawning workers costs more than it saves
+#define TRANSFORM_CHUNK 16384
+
+static inline const vec3 &positionAt(const vec3 *positions, size_t stride,
+size_t i)
+{
+	return *(const vec3*)((const unsigned char*)positions + i * stride);
+}
+
+#ifdef BOUNDS_SSE
+
+// unaligned load of x, y, z, reading one float past the vector
+static inline __m128 load3Overread(const vec3 &v)
+{
+	return _mm_loadu_ps(&v[0]);
+}
+
+static inline __m128 load3(const vec3 &v)
+{
+	return _mm_set_ps(0.0f, v[2], v[1], v[0]);
+}
+
+static inline vec3 store3(__m128 v)
+{
+	float f[4];
+	_mm_storeu_ps(f, v);
+	return vec3(f[0], f[1], f[2]);
+}
+
+void gl::computeBounds(const vec3 *positions, size_t count, size_t stride,
+Volume &volume, Sphere &sphere)
+{
+	if(!count) {
+		volume = Volume(vec3(0.0f), vec3(0.0f));
+		sphere = Sphere(vec3(0.0f), 0.0f);
+		return;
+	}
+
+	// the last position may be the last vec3 of the array, only read past
+	// it when the stride leaves room for a fourth float
+	size_t wide = stride >= sizeof(float) * 4 ? count : count - 1;
+
+	__m128 min0 = _mm_set1_ps(FLT_MAX), min1 = min0;
+	__m128 max0 = _mm_set1_ps(-FLT_MAX), max1 = max0;
+
+	// two independent accumulators hide min/max latency
+	size_t i = 0;
+	for(; i + 1 < wide; i += 2) {
+		__m128 a = load3Overread(positionAt(positions, stride, i));
+		__m128 b = load3Overread(positionAt(positions, stride, i + 1));
+
+		min0 = _mm_min_ps(min0, a);
+		max0 = _mm_max_ps(max0, a);
+		min1 = _mm_min_ps(min1, b);
+		max1 = _mm_max_ps(max1, b);
+	}
+
+	for(; i < count; ++i) {
+		__m128 a = load3(positionAt(positions, stride, i));
+
+		min0 = _mm_min_ps(min0, a);
+		max0 = _mm_max_ps(max0, a);
+	}
+
+	__m128 vmin = _mm_min_ps(min0, min1);
+	__m128 vmax = _mm_max_ps(max0, max1);
+
+	volume = Volume(store3(vmin), store3(vmax));
+
+	// sphere around the box center enclosing every position
+	__m128 center = _mm_mul_ps(_mm_add_ps(vmin, vmax), _mm_set1_ps(0.5f));
+	__m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	__m128 r0 = _mm_setzero_ps(), r1 = r0;
+
+	for(i = 0; i + 1 < wide; i += 2) {
+		__m128 a = _mm_sub_ps(load3Overread(positionAt(positions, stride, i)), center);
+		__m128 b = _mm_sub_ps(load3Overread(positionAt(positions, stride, i + 1)), center);
+
+		a = _mm_and_ps(a, mask);
+		b = _mm_and_ps(b, mask);
+
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+
+		// horizontal x + y + z, lane 0
+		a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+		a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+		b = _mm_add_ps(b, _mm_movehl_ps(b, b));
+		b = _mm_add_ss(b, _mm_shuffle_ps(b, b, 1));
+
+		r0 = _mm_max_ss(r0, a);
+		r1 = _mm_max_ss(r1, b);
+	}
+
+	for(; i < count; ++i) {
+		__m128 a = _mm_sub_ps(load3(positionAt(positions, stride, i)), center);
+
+		a = _mm_and_ps(a, mask);
+		a = _mm_mul_ps(a, a);
+		a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+		a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+
+		r0 = _mm_max_ss(r0, a);
+	}
+
+	sphere = Sphere(store3(center), sqrtf(_mm_cvtss_f32(_mm_max_ss(r0, r1))));
+}
+
+static inline void transformVolume(const Volume &in, const mat4 &m, Volume &out)
+{
+	__m128 c0 = _mm_loadu_ps(&m[0][0]);
+	__m128 c1 = _mm_loadu_ps(&m[1][0]);
+	__m128 c2 = _mm_loadu_ps(&m[2][0]);
+	__m128 c3 = _mm_loadu_ps(&m[3][0]);
+
+	__m128 signMask = _mm_set1_ps(-0.0f);
+
+	vec3 c = 0.5f * (in.min + in.max);
+	vec3 e = 0.5f * (in.max - in.min);
+
+	// center by the full matrix, extent by the absolute upper 3x3 (Arvo)
+	__m128 center = _mm_add_ps(
+	_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(c[0])), _mm_mul_ps(c1, _mm_set1_ps(c[1]))),
+	_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(c[2])), c3));
+
+	__m128 extent = _mm_add_ps(
+	_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, c0), _mm_set1_ps(e[0])),
+	_mm_mul_ps(_mm_andnot_ps(signMask, c1), _mm_set1_ps(e[1]))),
+	_mm_mul_ps(_mm_andnot_ps(signMask, c2), _mm_set1_ps(e[2])));
+
+	out = Volume(store3(_mm_sub_ps(center, extent)),
+	store3(_mm_add_ps(center, extent)));
+}
+
+#else
+
+void gl::computeBounds(const vec3 *positions, size_t count, size_t stride,
+Volume &volume, Sphere &sphere)
+{
+	if(!count) {
+		volume = Volume(vec3(0.0f), vec3(0.0f));
+		sphere = Sphere(vec3(0.0f), 0.0f);
+		return;
+	}
+
+	vec3 vmin(FLT_MAX), vmax(-FLT_MAX);
+
+	for(size_t i = 0; i < count; ++i) {
+		const vec3 &p = positionAt(positions, stride, i);
+		vmin = glm::min(vmin, p);
+		vmax = glm::max(vmax, p);
+	}
+
+	volume = Volume(vmin, vmax);
+
+	vec3 center = 0.5f * (vmin + vmax);
+	float radius = 0.0f;
+
+	for(size_t i = 0; i < count; ++i)
+		radius = fmaxf(radius, lengthSq(positionAt(positions, stride, i) - center));
+
+	sphere = Sphere(center, sqrtf(radius));
+}
+
+static inline void transformVolume(const Volume &in, const mat4 &m, Volume &out)
+{
+	vec3 c = 0.5f * (in.min + in.max);
+	vec3 e = 0.5f * (in.max - in.min);
+
+	vec3 center = vec3(m * vec4(c, 1.0f));
+	vec3 extent = glm::abs(vec3(m[0])) * e[0] + glm::abs(vec3(m[1])) * e[1] +
+	glm::abs(vec3(m[2])) * e[2];
+
+	out = Volume(center - extent, center + extent);
+}
+
+#endif
+
+void gl::transformVolumes(const Volume *in, const mat4 *matrices, Volume *out,
+size_t count)
+{
+	parallelFor(0, count, TRANSFORM_CHUNK, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			transformVolume(in[i], matrices[i], out[i]);
+	});
+}
+
+void gl::transformVolumes(const Volume &in, const mat4 *matrices, Volume *out,
+size_t count)
+{
+	parallelFor(0, count, TRANSFORM_CHUNK, [&](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+			transformVolume(in, matrices[i], out[i]);
+	});
+}
@@ -0,0 +1,25 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include "volumes.h"
+
+namespace gl {
+	// Axis aligned box and bounding sphere of count positions laid out
+	// stride bytes apart, e.g. &vertices[0].pos with sizeof(Vertex).
+	void computeBounds(const glm::vec3 *positions, size_t count, size_t stride,
+	Volume &volume, Sphere &sphere);
+
+	// World space boxes of local boxes in[i] transformed by matrices[i],
+	// large batches are split across threads.
+	void transformVolumes(const Volume *in, const glm::mat4 *matrices,
+	Volume *out, size_t count);
+
+	// Same, with every instance sharing a single local box.
+	void transformVolumes(const Volume &in, const glm::mat4 *matrices,
+	Volume *out, size_t count);
+
+} // namespace gl
+
+#endif
@@ -1,47 +1,102 @@
 #include "camera.h"
 
 #define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 using namespace glm;
 
+// same order as rotating by x, then y, then z
+static quat eulerToQuat(vec3 degrees)
+{
+	return angleAxis(radians(degrees.x), vec3(1.0f, 0.0f, 0.0f)) *
+	angleAxis(radians(degrees.y), vec3(0.0f, 1.0f, 0.0f)) *
+	angleAxis(radians(degrees.z), vec3(0.0f, 0.0f, 1.0f));
+}
+
 Camera::Camera()
 {
 
 }
 
-mat4 Camera::view()
+const mat4 &Camera::view() const
 {
-	if (updated) {
+	if (viewDirty)
 		updateView();
-		updated = false;
-	}
 
 	return viewMatrix;
 }
 
-mat4 Camera::projection()
+const mat4 &Camera::projection() const
 {
 	return projMatrix;
 }
 
-vec3 Camera::direction()
+const mat4 &Camera::viewProjection() const
+{
+	if (derivedDirty)
+		updateDerived();
+
+	return viewProjMatrix;
+}
+
+const mat4 &Camera::inverseView() const
+{
+	if (viewDirty)
+		updateView();
+
+	return inverseViewMatrix;
+}
+
+const mat4 &Camera::inverseProjection() const
+{
+	if (derivedDirty)
+		updateDerived();
+
+	return inverseProjMatrix;
+}
+
+const mat4 &Camera::inverseViewProjection() const
+{
+	if (derivedDirty)
+		updateDerived();
+
+	return inverseViewProjMatrix;
+}
+
+const Frustum &Camera::frustum() const
+{
+	if (derivedDirty)
+		updateDerived();
+
+	return frustumPlanes;
+}
+
+const vec3 *Camera::corners() const
+{
+	if (derivedDirty)
+		updateDerived();
+
+	return frustumCorners;
+}
+
+const vec3 &Camera::direction() const
 {
-	glm::vec3 camFront;
+	if (viewDirty)
+		updateView();
 
-	camFront.x = -cos(glm::radians(rotation.x)) * sin(glm::radians(rotation.y));
-	camFront.y = sin(glm::radians(rotation.x));
-	camFront.z = cos(glm::radians(rotation.x)) * cos(glm::radians(rotation.y));
-	camFront = glm::normalize(camFront);
+	return front;
+}
 
-	return camFront;
+uint64_t Camera::version() const
+{
+	return changes;
 }
 
 void Camera::setType(CameraType type)
 {
 	this->type = type;
+	viewChanged();
 }
 
 void Camera::setPerspective(float fov, float aspect, float znear, float zfar)
@@ -51,6 +106,7 @@ void Camera::setPerspective(float fov, float aspect, float znear, float zfar)
 	this->znear = znear;
 	this->zfar = zfar;
 	projMatrix = glm::perspective(glm::radians(fov), aspect, znear, zfar);
+	projectionChanged();
 }
 
 void Camera::setOrtho(float left, float right, float top, float bottom, float znear, float zfar)
@@ -58,69 +114,120 @@ void Camera::setOrtho(float left, float right, float top, float bottom, float zn
 	this->znear = znear;
 	this->zfar = zfar;
 	projMatrix = glm::ortho(left, right, top, bottom, znear, zfar);
+	projectionChanged();
 }
 
 void Camera::updateAspectRatio(float aspect)
 {
 	this->aspect = aspect;
 	projMatrix = glm::perspective(glm::radians(fov), aspect, znear, zfar);
+	projectionChanged();
 }
 
 void Camera::setPosition(vec3 position)
 {
 	this->position = position;
-	updated = true;
+	viewChanged();
 }
 
 void Camera::setRotation(vec3 rotation)
 {
 	this->rotation = rotation;
-	updated = true;
+	orientation = eulerToQuat(rotation);
+	viewChanged();
+}
+
+void Camera::setOrientation(const quat &orientation)
+{
+	this->orientation = normalize(orientation);
+	viewChanged();
 }
 
 void Camera::rotate(vec3 delta)
 {
 	this->rotation += delta;
-	updated = true;
+	orientation = eulerToQuat(rotation);
+	viewChanged();
 }
 
 void Camera::setTranslation(vec3 translation)
 {
 	this->position = translation;
-	updated = true;
+	viewChanged();
 }
 
 void Camera::translate(vec3 delta)
 {
 	this->position += delta;
-	updated = true;
+	viewChanged();
 }
 
 void Camera::setFov(float fov)
 {
 	this->fov = fov;
 	projMatrix = glm::perspective(glm::radians(fov), aspect, znear, zfar);
+	projectionChanged();
 }
 
-void Camera::updateView()
+void Camera::viewChanged()
+{
+	viewDirty = true;
+	derivedDirty = true;
+	changes++;
+}
 
+void Camera::projectionChanged()
 {
-	glm::mat4 rotM = glm::mat4(1.0f);
-	glm::mat4 transM;
+	derivedDirty = true;
+	changes++;
+}
 
-	rotM = glm::rotate(rotM, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotM = glm::rotate(rotM, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotM = glm::rotate(rotM, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+void Camera::updateView() const
+{
+	mat4 rotM = mat4_cast(orientation);
+	mat4 transM = glm::translate(glm::mat4(1.0f), position);
 
-	glm::vec3 translation = position;
-	transM = glm::translate(glm::mat4(1.0f), translation);
+	// both are rigid, their inverses come without a general inverse()
+	mat4 rotInv = transpose(rotM);
+	mat4 transInv = glm::translate(glm::mat4(1.0f), -position);
 
-	if (type == FPS)
+	if (type == FPS) {
 		viewMatrix = rotM * transM;
-	else
+		inverseViewMatrix = transInv * rotInv;
+	} else {
 		viewMatrix = transM * rotM;
+		inverseViewMatrix = rotInv * transInv;
+	}
+
+	front = normalize(conjugate(orientation) * vec3(0.0f, 0.0f, 1.0f));
 
-	viewPos = glm::vec4(position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
+	viewDirty = false;
+}
+
+void Camera::updateDerived() const
+{
+	if (viewDirty)
+		updateView();
+
+	viewProjMatrix = projMatrix * viewMatrix;
+	inverseProjMatrix = inverse(projMatrix);
+	inverseViewProjMatrix = inverseViewMatrix * inverseProjMatrix;
+	frustumPlanes = Frustum(viewProjMatrix);
+
+	// OpenGL depth range, near plane at -1, far at 1, as Frustum assumes
+	static const vec4 ndc[8] = {
+		vec4(-1.0f, -1.0f, -1.0f, 1.0f), vec4(1.0f, -1.0f, -1.0f, 1.0f),
+		vec4(1.0f, 1.0f, -1.0f, 1.0f), vec4(-1.0f, 1.0f, -1.0f, 1.0f),
+		vec4(-1.0f, -1.0f, 1.0f, 1.0f), vec4(1.0f, -1.0f, 1.0f, 1.0f),
+		vec4(1.0f, 1.0f, 1.0f, 1.0f), vec4(-1.0f, 1.0f, 1.0f, 1.0f)
+	};
+
+	for (int i = 0; i < 8; i++) {
+		vec4 corner = inverseViewProjMatrix * ndc[i];
+		frustumCorners[i] = vec3(corner) / corner.w;
+	}
+
+	derivedDirty = false;
 }
 
 void Camera::fitInView(float xMin, float xMax, float yMin, float yMax)
@@ -148,4 +255,12 @@ float Camera::getZfar() const
 	return zfar;
 }
 
+const vec3 &Camera::getPosition() const
+{
+	return position;
+}
 
+const quat &Camera::getOrientation() const
+{
+	return orientation;
+}
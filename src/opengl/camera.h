@@ -1,8 +1,18 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <cstdint>
+
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "volumes.h"
 
+// Orientation is a quaternion, the Euler setters compose one from pitch,
+// yaw and roll in degrees. Derived state (view-projection, inverses,
+// frustum planes and corners) is computed on first use after a change
+// and cached. version() changes with every change, so culling and LOD
+// can skip work while it stays the same.
 class Camera {
 
 	public:
@@ -10,19 +20,35 @@ class Camera {
 
 		Camera();
 
-		glm::mat4 view();
-		glm::mat4 projection();
-		glm::vec3 direction();
+		const glm::mat4 &view() const;
+		const glm::mat4 &projection() const;
+		const glm::mat4 &viewProjection() const;
+		const glm::mat4 &inverseView() const;
+		const glm::mat4 &inverseProjection() const;
+		const glm::mat4 &inverseViewProjection() const;
+
+		// planes and world space corners of the view volume, near
+		// corners first, each in the order of NDC (-1,-1) (1,-1) (1,1) (-1,1)
+		const Frustum &frustum() const;
+		const glm::vec3 *corners() const;
+
+		// front vector of the camera in world space
+		const glm::vec3 &direction() const;
+
+		// bumped by every change to the view or projection
+		uint64_t version() const;
 
 		void setType(CameraType type);
 		void setPerspective(float fov, float aspect, float znear, float zfar);
 		void setOrtho(float left, float right, float top, float bottom, float znear, float zfar);
 		void setPosition(glm::vec3 position);
 		void setRotation(glm::vec3 rotation);
+		void setOrientation(const glm::quat &orientation);
 		void setTranslation(glm::vec3 translation);
 		void setFov(float fov);
 
 		void updateAspectRatio(float aspect);
+		// adds to the Euler angles last set through setRotation()
 		void rotate(glm::vec3 delta);
 		void translate(glm::vec3 delta);
 		void fitInView(float xMin, float xMax, float yMin, float yMax);
@@ -35,23 +61,42 @@ class Camera {
 		float getZnear() const;
 		float getZfar() const;
 
+		const glm::vec3 &getPosition() const;
+		const glm::quat &getOrientation() const;
+
 	private:
-		void updateView();
+		void viewChanged();
+		void projectionChanged();
+		void updateView() const;
+		void updateDerived() const;
 
 		CameraType type = CameraType::LOOKAT;
 
-		glm::vec3 position;
-		glm::vec3 rotation;
-		glm::vec4 viewPos;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 rotation = glm::vec3(0.0f);
+		glm::quat orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+		float fov = 60.0f;
+		float aspect = 1.0f;
+		float znear = 0.1f, zfar = 100.0f;
+
+		uint64_t changes = 1;
+
+		glm::mat4 projMatrix = glm::mat4(1.0f);
 
-		float fov;
-		float aspect;
-		float znear, zfar;
+		// caches, rebuilt when their flag is set
+		mutable bool viewDirty = true;
+		mutable bool derivedDirty = true;
 
-		bool updated = false;
+		mutable glm::mat4 viewMatrix;
+		mutable glm::mat4 inverseViewMatrix;
+		mutable glm::vec3 front;
 
-		glm::mat4 projMatrix;
-		glm::mat4 viewMatrix;
+		mutable glm::mat4 viewProjMatrix;
+		mutable glm::mat4 inverseProjMatrix;
+		mutable glm::mat4 inverseViewProjMatrix;
+		mutable Frustum frustumPlanes;
+		mutable glm::vec3 frustumCorners[8];
 };
 
 #endif // CAMERA_H
@@ -0,0 +1,128 @@
+#include "culling.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace gl;
+using namespace glm;
+
+// instances per chunk, and chunks a thread must get before spawning it
+#define CULL_CHUNK 4096
+#define CULL_MIN_CHUNKS 4
+
+// visible instances gathered before computing their normal matrices
+#define NORMAL_BATCH 64
+
+static inline bool visible(const mat4 &m, const vec3 &center,
+const vec3 &extent, float radius, const Frustum &frustum)
+{
+	vec3 c = vec3(m[0]) * center[0] + vec3(m[1]) * center[1] +
+	vec3(m[2]) * center[2] + vec3(m[3]);
+
+	// bounding sphere first, scaled by the largest axis scale
+	float scale = std::max(lengthSq(vec3(m[0])),
+	std::max(lengthSq(vec3(m[1])), lengthSq(vec3(m[2]))));
+	float r = radius * sqrtf(scale);
+
+	bool inside = true;
+
+	for(int i = 0; i < 6; ++i) {
+		float d = frustum.distance(i, c);
+
+		if(d < -r)
+			return false;
+
+		if(d < r)
+			inside = false;
+	}
+
+	if(inside)
+		return true;
+
+	// straddling a plane, refine with the world space box
+	vec3 e = abs(vec3(m[0])) * extent[0] + abs(vec3(m[1])) * extent[1] +
+	abs(vec3(m[2])) * extent[2];
+
+	return frustum.intersect(Volume(c - e, c + e));
+}
+
+size_t InstanceCuller::cull(const mat4 *instances, size_t count,
+const Volume &local, const Frustum &frustum, mat4 *out, NormalMatrix *normals)
+{
+	if(!count)
+		return 0;
+
+	vec3 center = 0.5f * (local.min + local.max);
+	vec3 extent = 0.5f * (local.max - local.min);
+	float radius = sqrtf(lengthSq(extent));
+
+	size_t chunks = (count + CULL_CHUNK - 1) / CULL_CHUNK;
+
+	m_visible.resize(count);
+	m_offsets.resize(chunks + 1);
+
+	// test and count survivors per chunk
+	parallelFor(0, chunks, CULL_MIN_CHUNKS, [&](size_t begin, size_t end) {
+		for(size_t c = begin; c < end; ++c) {
+			size_t first = c * CULL_CHUNK;
+			size_t last = std::min(count, first + CULL_CHUNK);
+			size_t survivors = 0;
+
+			for(size_t i = first; i < last; ++i) {
+				unsigned char v = visible(instances[i], center, extent,
+				radius, frustum);
+
+				m_visible[i] = v;
+				survivors += v;
+			}
+
+			m_offsets[c + 1] = survivors;
+		}
+	});
+
+	// exclusive prefix sum of the chunk counts
+	m_offsets[0] = 0;
+	for(size_t c = 0; c < chunks; ++c)
+		m_offsets[c + 1] += m_offsets[c];
+
+	// compact, every chunk writes its own disjoint output range
+	parallelFor(0, chunks, CULL_MIN_CHUNKS, [&](size_t begin, size_t end) {
+		for(size_t c = begin; c < end; ++c) {
+			size_t first = c * CULL_CHUNK;
+			size_t last = std::min(count, first + CULL_CHUNK);
+			mat4 *dst = out + m_offsets[c];
+
+			if(!normals) {
+				for(size_t i = first; i < last; ++i) {
+					if(m_visible[i])
+						memcpy(dst++, &instances[i], sizeof(mat4));
+				}
+
+				continue;
+			}
+
+			// gather survivors in small batches, the output may be write
+			// only mapped memory that must not be read back
+			NormalMatrix *normalDst = normals + m_offsets[c];
+			mat4 batch[NORMAL_BATCH];
+			size_t n = 0;
+
+			for(size_t i = first; i < last; ++i) {
+				if(m_visible[i])
+					batch[n++] = instances[i];
+
+				if(n == NORMAL_BATCH || (i + 1 == last && n)) {
+					memcpy(dst, batch, n * sizeof(mat4));
+					computeNormalMatrices(batch, n, normalDst);
+
+					dst += n;
+					normalDst += n;
+					n = 0;
+				}
+			}
+		}
+	});
+
+	return m_offsets[chunks];
+}
@@ -0,0 +1,32 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "volumes.h"
+#include "normal_matrix.h"
+
+namespace gl {
+	// Frustum culling of instance matrices sharing one local bounding box.
+	// Instances are tested in fixed size chunks across all cores, chunk
+	// survivor counts are prefix summed and every chunk then writes its
+	// visible matrices at its own offset, keeping the original order.
+	class InstanceCuller {
+		public:
+			// write visible instances into out, which must have room for
+			// count matrices, returns the number written. With normals
+			// the normal matrix of every visible instance goes there too.
+			size_t cull(const glm::mat4 *instances, size_t count,
+			const Volume &local, const Frustum &frustum, glm::mat4 *out,
+			NormalMatrix *normals = nullptr);
+
+		private:
+			std::vector<unsigned char> m_visible;
+			std::vector<size_t> m_offsets;
+	};
+
+} // namespace gl
+
+#endif
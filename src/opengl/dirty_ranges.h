@@ -0,0 +1,81 @@
+#ifndef DIRTY_RANGES_H
+#define DIRTY_RANGES_H
+
+#include <vector>
+#include <algorithm>
+
+// Sorted set of modified [begin, end) element ranges. Ranges closer than
+// mergeGap elements are coalesced, trading a few redundant elements for
+// fewer upload calls.
+class DirtyRanges {
+public:
+    struct Range {
+        size_t begin;
+        size_t end;
+
+        size_t size() const { return end - begin; }
+    };
+
+    DirtyRanges(size_t mergeGap = 0) : m_mergeGap(mergeGap) { }
+
+    void setMergeGap(size_t gap) { m_mergeGap = gap; }
+
+    void mark(size_t first, size_t count)
+    {
+        if(!count)
+            return;
+
+        Range range = {first, first + count};
+
+        // first range that could touch the new one
+        auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), range,
+        [this](const Range &a, const Range &b) {
+            return a.end + m_mergeGap < b.begin;
+        });
+
+        auto last = it;
+        while(last != m_ranges.end() && last->begin <= range.end + m_mergeGap) {
+            range.begin = std::min(range.begin, last->begin);
+            range.end = std::max(range.end, last->end);
+            ++last;
+        }
+
+        it = m_ranges.erase(it, last);
+        m_ranges.insert(it, range);
+    }
+
+    void markAll(size_t count)
+    {
+        m_ranges.clear();
+        mark(0, count);
+    }
+
+    // clamp ranges to the current element count, e.g. after a resize
+    void clamp(size_t count)
+    {
+        while(m_ranges.size() && m_ranges.back().begin >= count)
+            m_ranges.pop_back();
+
+        if(m_ranges.size())
+            m_ranges.back().end = std::min(m_ranges.back().end, count);
+    }
+
+    size_t elements() const
+    {
+        size_t total = 0;
+        for(const Range &r : m_ranges)
+            total += r.size();
+        return total;
+    }
+
+    bool empty() const { return m_ranges.empty(); }
+    void clear() { m_ranges.clear(); }
+
+    const std::vector<Range> &ranges() const { return m_ranges; }
+
+private:
+    std::vector<Range> m_ranges;
+    size_t m_mergeGap;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "frame_clock.h"
+
+#include <SDL2/SDL.h>
+
+using namespace gl;
+
+// weight of the newest frame in the moving average
+#define FRAME_SMOOTHING 0.1
+
+// SDL_Delay() can overshoot by a scheduler tick, stop sleeping this
+// early and spin the rest
+#define SLEEP_MARGIN 0.002
+
+FrameClock::FrameClock()
+{
+	m_secondsPerCount = 1.0 / SDL_GetPerformanceFrequency();
+	reset();
+}
+
+void FrameClock::reset()
+{
+	m_last = SDL_GetPerformanceCounter();
+	m_timing = FrameTiming();
+
+	m_windowStart = m_last * m_secondsPerCount;
+	m_windowMin = 0.0;
+	m_windowMax = 0.0;
+}
+
+void FrameClock::resume()
+{
+	m_last = SDL_GetPerformanceCounter();
+}
+
+double FrameClock::tick()
+{
+	uint64_t counter = SDL_GetPerformanceCounter();
+	double dt = (counter - m_last) * m_secondsPerCount;
+	m_last = counter;
+
+	FrameTiming &t = m_timing;
+
+	t.frameTime = dt;
+	t.average = t.frames ? t.average + (dt - t.average) * FRAME_SMOOTHING : dt;
+	t.fps = t.average > 0.0 ? 1.0 / t.average : 0.0;
+
+	if(!t.frames || dt < m_windowMin)
+		m_windowMin = dt;
+
+	if(!t.frames || dt > m_windowMax)
+		m_windowMax = dt;
+
+	t.frames++;
+
+	// until the first second is over show what there is
+	double now = counter * m_secondsPerCount;
+
+	if(now - m_windowStart >= 1.0 || t.frames == 1) {
+		t.minimum = m_windowMin;
+		t.maximum = m_windowMax;
+
+		if(now - m_windowStart >= 1.0) {
+			m_windowStart = now;
+			m_windowMin = m_windowMax = dt;
+		}
+	}
+
+	return dt;
+}
+
+void FrameClock::limit(double maxFps)
+{
+	if(maxFps <= 0.0)
+		return;
+
+	uint64_t target = m_last + uint64_t(1.0 / maxFps / m_secondsPerCount);
+
+	for(;;) {
+		uint64_t counter = SDL_GetPerformanceCounter();
+
+		if(counter >= target)
+			break;
+
+		double remaining = (target - counter) * m_secondsPerCount;
+
+		if(remaining > SLEEP_MARGIN)
+			SDL_Delay(uint32_t((remaining - SLEEP_MARGIN) * 1000.0));
+	}
+}
+
+const FrameTiming &FrameClock::timing() const
+{
+	return m_timing;
+}
+
+double FrameClock::now()
+{
+	return SDL_GetPerformanceCounter() / double(SDL_GetPerformanceFrequency());
+}
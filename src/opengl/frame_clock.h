@@ -0,0 +1,57 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <cstdint>
+
+namespace gl {
+	// frame time figures in seconds, smoothed so they can be shown as is
+	struct FrameTiming {
+		double frameTime = 0.0; // last frame, unsmoothed
+		double average = 0.0; // exponential moving average
+		double minimum = 0.0; // over the last full second
+		double maximum = 0.0;
+		double fps = 0.0; // 1 / average, 0 before the first frame
+		uint64_t frames = 0;
+	};
+
+	// Frame timing on SDL_GetPerformanceCounter(), the resolution of the
+	// platform's high resolution clock instead of SDL_GetTicks()
+	// milliseconds.
+	class FrameClock {
+		public:
+			FrameClock();
+
+			// restart timing, the next tick() measures from now
+			void reset();
+
+			// the next tick() measures from now, statistics are kept. For
+			// resuming after an idle wait
+			void resume();
+
+			// seconds since the previous tick, updates timing()
+			double tick();
+
+			// wait until 1 / maxFps seconds after the last tick. Sleeps
+			// while far enough away for the scheduler, spins the rest
+			void limit(double maxFps);
+
+			const FrameTiming &timing() const;
+
+			// seconds on the performance counter
+			static double now();
+
+		private:
+			uint64_t m_last;
+			double m_secondsPerCount;
+
+			FrameTiming m_timing;
+
+			// running minimum and maximum, published once a second
+			double m_windowStart;
+			double m_windowMin;
+			double m_windowMax;
+	};
+
+} // namespace gl
+
+#endif
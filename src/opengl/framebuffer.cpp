@@ -0,0 +1,219 @@
+#include "framebuffer.h"
+#include "image_decoder.h"
+#include "state_cache.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace gl;
+using namespace std;
+
+Framebuffer::Framebuffer()
+{
+
+}
+
+Framebuffer::~Framebuffer()
+{
+	// GL objects die with the context, release() deletes them before that
+}
+
+bool Framebuffer::create(int width, int height)
+{
+	release();
+
+	m_width = width;
+	m_height = height;
+
+	glGenRenderbuffers(1, &m_color);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &m_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &m_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+	GL_RENDERBUFFER, m_color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+	GL_RENDERBUFFER, m_depth);
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "Incomplete framebuffer " << width << "x" << height << endl;
+		release();
+		return false;
+	}
+
+	return true;
+}
+
+void Framebuffer::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+}
+
+void Framebuffer::readPixels(unsigned char *rgba)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+
+	// rows are tightly packed, whatever pack buffer was bound is not ours
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+
+	// GL starts at the bottom row
+	flipRows(rgba, size_t(m_width) * 4, m_height);
+}
+
+int Framebuffer::width() const
+{
+	return m_width;
+}
+
+int Framebuffer::height() const
+{
+	return m_height;
+}
+
+void Framebuffer::release()
+{
+	if(m_fbo) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &m_fbo);
+	}
+
+	if(m_color)
+		glDeleteRenderbuffers(1, &m_color);
+
+	if(m_depth)
+		glDeleteRenderbuffers(1, &m_depth);
+
+	m_fbo = m_color = m_depth = 0;
+}
+
+static uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc)
+{
+	static uint32_t table[256];
+
+	if(!table[1]) {
+		for(uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+
+			for(int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+
+			table[i] = c;
+		}
+	}
+
+	crc = ~crc;
+
+	for(size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void putBigEndian(vector<unsigned char> &out, uint32_t value)
+{
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+static void writeChunk(FILE *file, const char *type,
+const vector<unsigned char> &data)
+{
+	vector<unsigned char> chunk;
+
+	putBigEndian(chunk, data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+
+	// the crc covers type and data
+	putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4, 0));
+
+	fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+bool gl::writePng(const string &path, const unsigned char *rgba, int width,
+int height)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+
+	if(!file)
+		return false;
+
+	static const unsigned char signature[8] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+	};
+
+	fwrite(signature, 1, sizeof(signature), file);
+
+	vector<unsigned char> header;
+	putBigEndian(header, width);
+	putBigEndian(header, height);
+	header.push_back(8); // bits per channel
+	header.push_back(6); // RGBA
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+
+	writeChunk(file, "IHDR", header);
+
+	// scanlines each led by filter type 0
+	size_t rowBytes = size_t(width) * 4;
+	vector<unsigned char> raw;
+	raw.reserve((rowBytes + 1) * height);
+
+	for(int y = 0; y < height; y++) {
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+	}
+
+	// zlib stream of stored deflate blocks, speed over size
+	vector<unsigned char> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+
+	uint32_t a = 1, b = 0;
+
+	for(size_t offset = 0; offset < raw.size() || !offset; ) {
+		size_t length = min(raw.size() - offset, size_t(65535));
+		bool last = offset + length == raw.size();
+
+		zlib.push_back(last);
+		zlib.push_back(length);
+		zlib.push_back(length >> 8);
+		zlib.push_back(~length);
+		zlib.push_back(~length >> 8);
+		zlib.insert(zlib.end(), raw.begin() + offset,
+		raw.begin() + offset + length);
+
+		for(size_t i = offset; i < offset + length; i++) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+
+		offset += length;
+
+		if(last)
+			break;
+	}
+
+	putBigEndian(zlib, (b << 16) | a);
+
+	writeChunk(file, "IDAT", zlib);
+	writeChunk(file, "IEND", vector<unsigned char>());
+
+	bool written = !ferror(file);
+
+	return !fclose(file) && written;
+}
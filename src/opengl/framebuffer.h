@@ -0,0 +1,43 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <string>
+
+namespace gl {
+	// RGBA8 color and 24 bit depth render target
+	class Framebuffer {
+		public:
+			Framebuffer();
+			~Framebuffer();
+
+			Framebuffer(const Framebuffer &) = delete;
+			Framebuffer &operator=(const Framebuffer &) = delete;
+
+			bool create(int width, int height);
+
+			// make it the draw and read framebuffer
+			void bind();
+
+			// tightly packed RGBA8, top row first
+			void readPixels(unsigned char *rgba);
+
+			int width() const;
+			int height() const;
+
+			// delete GL objects, the context must be current
+			void release();
+
+		private:
+			unsigned int m_fbo = 0;
+			unsigned int m_color = 0;
+			unsigned int m_depth = 0;
+			int m_width = 0, m_height = 0;
+	};
+
+	// write RGBA8 pixels, top row first, as an uncompressed PNG
+	bool writePng(const std::string &path, const unsigned char *rgba,
+	int width, int height);
+
+} // namespace gl
+
+#endif
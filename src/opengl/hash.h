@@ -0,0 +1,46 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+namespace gl {
+	// FNV-1a, usable at compile time for string keys
+	constexpr uint64_t fnv1a(const char *str, uint64_t hash = 0xcbf29ce484222325ull)
+	{
+		return *str ? fnv1a(str + 1, (hash ^ (unsigned char)*str) * 0x100000001b3ull) : hash;
+	}
+
+	inline uint64_t mix64(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// fast non cryptographic hash of a memory block, 8 bytes per step
+	inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0)
+	{
+		const unsigned char *p = (const unsigned char*)data;
+		uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ull);
+
+		for(; size >= 8; size -= 8, p += 8) {
+			uint64_t w;
+			memcpy(&w, p, 8);
+			h = (h ^ mix64(w)) * 0x9e3779b97f4a7c15ull;
+		}
+
+		uint64_t tail = 0;
+		if(size)
+			memcpy(&tail, p, size);
+
+		return mix64(h ^ tail);
+	}
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,146 @@
+#include "headless.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <EGL/eglext.h>
+
+using namespace gl;
+using namespace std;
+
+HeadlessContext::HeadlessContext()
+{
+
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	destroy();
+}
+
+static bool hasExtension(const char *extensions, const char *name)
+{
+	if(!extensions)
+		return false;
+
+	size_t length = strlen(name);
+
+	for(const char *at = strstr(extensions, name); at;
+	at = strstr(at + length, name)) {
+		if((at == extensions || at[-1] == ' ') &&
+		(at[length] == ' ' || !at[length]))
+			return true;
+	}
+
+	return false;
+}
+
+bool HeadlessContext::create(int major, int minor)
+{
+	const char *client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+	// surfaceless needs no X server, GBM device or pbuffer support
+	if(hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+		if(getPlatformDisplay) {
+			m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+			EGL_DEFAULT_DISPLAY, NULL);
+		}
+	}
+
+	if(m_display == EGL_NO_DISPLAY)
+		m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if(m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, NULL, NULL)) {
+		cerr << "Unable to initialize EGL" << endl;
+		m_display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	if(!eglBindAPI(EGL_OPENGL_API)) {
+		cerr << "EGL has no desktop OpenGL" << endl;
+		destroy();
+		return false;
+	}
+
+	bool surfaceless = hasExtension(eglQueryString(m_display, EGL_EXTENSIONS),
+	"EGL_KHR_surfaceless_context");
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_NONE
+	};
+
+	EGLConfig config;
+	EGLint configs = 0;
+
+	if(!eglChooseConfig(m_display, configAttributes, &config, 1, &configs) ||
+	!configs) {
+		cerr << "No EGL config for OpenGL" << endl;
+		destroy();
+		return false;
+	}
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_NONE
+	};
+
+	m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT,
+	contextAttributes);
+
+	if(m_context == EGL_NO_CONTEXT) {
+		cerr << "Unable to create an OpenGL " << major << "." << minor <<
+		" context through EGL" << endl;
+		destroy();
+		return false;
+	}
+
+	// everything renders to a Framebuffer, the surface only has to exist
+	if(!surfaceless) {
+		const EGLint pbufferAttributes[] = {
+			EGL_WIDTH, 1,
+			EGL_HEIGHT, 1,
+			EGL_NONE
+		};
+
+		m_surface = eglCreatePbufferSurface(m_display, config,
+		pbufferAttributes);
+	}
+
+	if(!eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+		cerr << "Unable to make the EGL context current" << endl;
+		destroy();
+		return false;
+	}
+
+	return true;
+}
+
+void HeadlessContext::destroy()
+{
+	if(m_display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+	if(m_surface != EGL_NO_SURFACE)
+		eglDestroySurface(m_display, m_surface);
+
+	if(m_context != EGL_NO_CONTEXT)
+		eglDestroyContext(m_display, m_context);
+
+	eglTerminate(m_display);
+
+	m_display = EGL_NO_DISPLAY;
+	m_context = EGL_NO_CONTEXT;
+	m_surface = EGL_NO_SURFACE;
+}
@@ -0,0 +1,31 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <EGL/egl.h>
+
+namespace gl {
+	// OpenGL context without a display or window, for build machines.
+	// Uses EGL on Mesa's surfaceless platform when the driver offers it,
+	// so it runs on llvmpipe with no GPU, and falls back to the default
+	// display with a tiny pbuffer. Rendering has to go to a Framebuffer.
+	class HeadlessContext {
+		public:
+			HeadlessContext();
+			~HeadlessContext();
+
+			HeadlessContext(const HeadlessContext &) = delete;
+			HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+			// create and make current a context of at least major.minor
+			bool create(int major, int minor);
+			void destroy();
+
+		private:
+			EGLDisplay m_display = EGL_NO_DISPLAY;
+			EGLContext m_context = EGL_NO_CONTEXT;
+			EGLSurface m_surface = EGL_NO_SURFACE;
+	};
+
+} // namespace gl
+
+#endif
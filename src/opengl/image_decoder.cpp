@@ -0,0 +1,218 @@
+#include "image_decoder.h"
+
+#include <mutex>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DECODER_SSE
+#endif
+
+#define STBI_MALLOC(size) gl::decodeAlloc(size)
+#define STBI_REALLOC(block, size) gl::decodeRealloc(block, size)
+#define STBI_FREE(block) gl::decodeFree(block)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+using namespace gl;
+using namespace std;
+
+// smallest pooled block, and the most the free lists hold together
+#define POOL_MIN_SHIFT 16
+#define POOL_MAX_BYTES (64u * 1024 * 1024)
+#define POOL_CLASSES 48
+
+// in front of every block, keeps the payload 16 byte aligned for SSE
+#define BLOCK_HEADER 16
+
+namespace {
+	struct Pool {
+		mutex lock;
+		vector<void*> free[POOL_CLASSES];
+		DecodePoolStats stats;
+	};
+
+	Pool &pool()
+	{
+		static Pool instance;
+		return instance;
+	}
+
+	// size class of a large block, -1 for small ones
+	int sizeClass(size_t size)
+	{
+		if(size < ((size_t)1 << POOL_MIN_SHIFT))
+			return -1;
+
+		int shift = POOL_MIN_SHIFT;
+
+		while(((size_t)1 << shift) < size)
+			shift++;
+
+		return shift;
+	}
+
+	size_t &capacity(void *block)
+	{
+		return *(size_t*)((unsigned char*)block - BLOCK_HEADER);
+	}
+}
+
+void *gl::decodeAlloc(size_t size)
+{
+	int c = sizeClass(size);
+
+	if(c < 0) {
+		unsigned char *raw = (unsigned char*)malloc(size + BLOCK_HEADER);
+
+		if(!raw)
+			return nullptr;
+
+		*(size_t*)raw = size;
+		return raw + BLOCK_HEADER;
+	}
+
+	size_t bytes = (size_t)1 << c;
+	Pool &p = pool();
+
+	{
+		lock_guard<mutex> guard(p.lock);
+		p.stats.allocations++;
+
+		if(p.free[c].size()) {
+			void *block = p.free[c].back();
+			p.free[c].pop_back();
+
+			p.stats.reuses++;
+			p.stats.pooledBytes -= bytes;
+			return block;
+		}
+	}
+
+	unsigned char *raw = (unsigned char*)malloc(bytes + BLOCK_HEADER);
+
+	if(!raw)
+		return nullptr;
+
+	*(size_t*)raw = bytes;
+	return raw + BLOCK_HEADER;
+}
+
+void *gl::decodeRealloc(void *block, size_t size)
+{
+	if(!block)
+		return decodeAlloc(size);
+
+	size_t old = capacity(block);
+
+	// pooled blocks often have the room already
+	if(size <= old && (sizeClass(old) < 0) == (sizeClass(size) < 0))
+		return block;
+
+	void *grown = decodeAlloc(size);
+
+	if(!grown)
+		return nullptr;
+
+	memcpy(grown, block, std::min(old, size));
+	decodeFree(block);
+
+	return grown;
+}
+
+void gl::decodeFree(void *block)
+{
+	if(!block)
+		return;
+
+	size_t bytes = capacity(block);
+	int c = sizeClass(bytes);
+
+	if(c >= 0) {
+		Pool &p = pool();
+		lock_guard<mutex> guard(p.lock);
+
+		if(p.stats.pooledBytes + bytes <= POOL_MAX_BYTES) {
+			p.free[c].push_back(block);
+			p.stats.pooledBytes += bytes;
+			return;
+		}
+	}
+
+	free((unsigned char*)block - BLOCK_HEADER);
+}
+
+DecodePoolStats gl::decodePoolStats()
+{
+	Pool &p = pool();
+	lock_guard<mutex> guard(p.lock);
+
+	return p.stats;
+}
+
+void gl::trimDecodePool()
+{
+	Pool &p = pool();
+	lock_guard<mutex> guard(p.lock);
+
+	for(vector<void*> &blocks : p.free) {
+		for(void *block : blocks)
+			free((unsigned char*)block - BLOCK_HEADER);
+
+		blocks.clear();
+	}
+
+	p.stats.pooledBytes = 0;
+}
+
+void gl::flipRows(unsigned char *pixels, size_t rowBytes, int rows)
+{
+	unsigned char *top = pixels;
+	unsigned char *bottom = pixels + (rows - 1) * rowBytes;
+
+	for(; top < bottom; top += rowBytes, bottom -= rowBytes) {
+		size_t i = 0;
+
+#ifdef DECODER_SSE
+		for(; i + 16 <= rowBytes; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+
+			_mm_storeu_si128((__m128i*)(top + i), b);
+			_mm_storeu_si128((__m128i*)(bottom + i), a);
+		}
+#endif
+
+		for(; i < rowBytes; ++i)
+			std::swap(top[i], bottom[i]);
+	}
+}
+
+unsigned char *gl::decodeImage(const unsigned char *data, size_t size,
+bool flip, int &width, int &height, int &channels)
+{
+	// the global flip stays off, flipping happens here per call
+	unsigned char *pixels = stbi_load_from_memory(data, (int)size, &width,
+	&height, &channels, 0);
+
+	if(pixels && flip)
+		flipRows(pixels, (size_t)width * channels, height);
+
+	return pixels;
+}
+
+void gl::freeImage(unsigned char *pixels)
+{
+	stbi_image_free(pixels);
+}
+
+bool gl::imageSize(const unsigned char *data, size_t size, int &width,
+int &height, int &channels)
+{
+	return stbi_info_from_memory(data, (int)size, &width, &height, &channels);
+}
@@ -0,0 +1,44 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include <cstddef>
+
+namespace gl {
+	// Decode a PNG, JPEG, TGA, ... held in memory. The flip is a per call
+	// setting instead of stb_image's process wide one, so any number of
+	// threads can decode at once. Returns nullptr on failure, the pixels
+	// go back to the pool with freeImage().
+	unsigned char *decodeImage(const unsigned char *data, size_t size, bool flip,
+	int &width, int &height, int &channels);
+	void freeImage(unsigned char *pixels);
+
+	// size and channels from the header alone, without decoding
+	bool imageSize(const unsigned char *data, size_t size, int &width,
+	int &height, int &channels);
+
+	// swap rows top to bottom in place, 16 bytes at a time
+	void flipRows(unsigned char *pixels, size_t rowBytes, int rows);
+
+	// Allocator behind stb_image. Blocks of 64KB and up are rounded to a
+	// power of two and kept on free lists when released, so the output
+	// and scratch buffers of a batch are reused image to image instead of
+	// mapped and faulted in again. Thread safe.
+	struct DecodePoolStats {
+		size_t allocations = 0; // large blocks requested
+		size_t reuses = 0; // of those served from the free lists
+		size_t pooledBytes = 0; // held on the free lists right now
+	};
+
+	void *decodeAlloc(size_t size);
+	void *decodeRealloc(void *block, size_t size);
+	void decodeFree(void *block);
+
+	DecodePoolStats decodePoolStats();
+
+	// give every pooled block back to the system, called when a batch
+	// or the asset loader is done
+	void trimDecodePool();
+
+} // namespace gl
+
+#endif
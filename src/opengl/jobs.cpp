@@ -0,0 +1,311 @@
+#include "jobs.h"
+
+#include <algorithm>
+
+using namespace gl;
+using namespace std;
+
+static atomic<JobSystem*> currentSystem(nullptr);
+
+// queue of the calling thread, 0 unless it is a worker of owner
+static thread_local const JobSystem *queueOwner = nullptr;
+static thread_local size_t queueIndex = 0;
+
+JobSystem::JobSystem(size_t workers) :
+m_queued(0), m_backgroundQueued(0), m_sleeping(0)
+{
+	if(!workers) {
+		size_t threads = thread::hardware_concurrency();
+		workers = threads > 1 ? threads - 1 : 1;
+	}
+
+	for(size_t i = 0; i <= workers; ++i)
+		m_queues.emplace_back(new Queue);
+
+	for(size_t i = 1; i <= workers; ++i)
+		m_workers.emplace_back(&JobSystem::work, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+		m_stop = true;
+	}
+
+	m_wake.notify_all();
+
+	for(thread &worker : m_workers)
+		worker.join();
+
+	if(currentSystem == this)
+		currentSystem = nullptr;
+}
+
+JobHandle JobSystem::submit(function<void()> fn)
+{
+	return submit(std::move(fn), {});
+}
+
+JobHandle JobSystem::submit(function<void()> fn,
+const vector<JobHandle> &dependencies)
+{
+	JobHandle job = make_shared<Job>();
+	job->fn = std::move(fn);
+	job->finished = false;
+	job->dependencies = 1;
+
+	for(const JobHandle &dependency : dependencies) {
+		if(!dependency)
+			continue;
+
+		lock_guard<mutex> lock(dependency->mutex);
+
+		if(!dependency->finished) {
+			dependency->continuations.push_back(job);
+			job->dependencies++;
+		}
+	}
+
+	// the last dependency to finish schedules it otherwise
+	if(!--job->dependencies)
+		schedule(job);
+
+	return job;
+}
+
+JobHandle JobSystem::then(const JobHandle &job, function<void()> fn)
+{
+	return submit(std::move(fn), {job});
+}
+
+JobHandle JobSystem::submitBackground(function<void()> fn)
+{
+	JobHandle job = make_shared<Job>();
+	job->fn = std::move(fn);
+	job->finished = false;
+	job->dependencies = 0;
+	job->background = true;
+
+	schedule(job);
+
+	return job;
+}
+
+bool JobSystem::done(const JobHandle &job) const
+{
+	return !job || job->finished;
+}
+
+void JobSystem::wait(const JobHandle &job)
+{
+	while(!done(job)) {
+		if(!runOne())
+			this_thread::yield();
+	}
+}
+
+void JobSystem::wait(const vector<JobHandle> &jobs)
+{
+	for(const JobHandle &job : jobs)
+		wait(job);
+}
+
+size_t JobSystem::threadCount() const
+{
+	return m_workers.size() + 1;
+}
+
+JobSystem *JobSystem::current()
+{
+	return currentSystem;
+}
+
+void JobSystem::setCurrent(JobSystem *jobs)
+{
+	currentSystem = jobs;
+}
+
+void JobSystem::work(size_t index)
+{
+	queueOwner = this;
+	queueIndex = index;
+
+	for(;;) {
+		JobHandle job = take(index, true);
+
+		if(!job)
+			job = takeBackground();
+
+		if(job) {
+			job->fn();
+			finish(*job);
+			continue;
+		}
+
+		unique_lock<mutex> lock(m_sleepMutex);
+
+		m_sleeping++;
+		m_wake.wait(lock, [this]() {
+			return m_stop || m_queued || m_backgroundQueued;
+		});
+		m_sleeping--;
+
+		// queued work still runs when stopping
+		if(m_stop && !m_queued && !m_backgroundQueued)
+			return;
+	}
+}
+
+void JobSystem::schedule(const JobHandle &job)
+{
+	if(job->background) {
+		m_backgroundQueued++;
+
+		{
+			lock_guard<mutex> lock(m_background.mutex);
+			m_background.jobs.push_back(job);
+		}
+
+		notify();
+		return;
+	}
+
+	Queue &queue = *m_queues[queueOwner == this ? queueIndex : 0];
+
+	// counted first, so a take() never drives the count below zero
+	m_queued++;
+
+	{
+		lock_guard<mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+
+	notify();
+}
+
+void JobSystem::notify()
+{
+	// a worker about to sleep checks the counts under the lock, taking it
+	// here means it either saw the job or is waiting for this notify
+	if(m_sleeping) {
+		{ lock_guard<mutex> lock(m_sleepMutex); }
+		m_wake.notify_one();
+	}
+}
+
+void JobSystem::finish(Job &job)
+{
+	vector<JobHandle> continuations;
+
+	// captures go as soon as the job is done
+	job.fn = nullptr;
+
+	{
+		lock_guard<mutex> lock(job.mutex);
+		job.finished = true;
+		continuations.swap(job.continuations);
+	}
+
+	for(const JobHandle &continuation : continuations) {
+		if(!--continuation->dependencies)
+			schedule(continuation);
+	}
+}
+
+bool JobSystem::runOne()
+{
+	// outside the pool only the shared queue, a job a worker spawned may
+	// be a chunk of an asset read the waiting frame has no business with
+	bool worker = queueOwner == this;
+	JobHandle job = take(worker ? queueIndex : 0, worker);
+
+	if(!job)
+		return false;
+
+	job->fn();
+	finish(*job);
+
+	return true;
+}
+
+JobHandle JobSystem::take(size_t index, bool steal)
+{
+	if(!m_queued)
+		return nullptr;
+
+	JobHandle job;
+
+	// newest own job first, its data is likely still in cache
+	{
+		Queue &own = *m_queues[index];
+		lock_guard<mutex> lock(own.mutex);
+
+		if(own.jobs.size()) {
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+		}
+	}
+
+	// then the oldest job of someone else, usually the biggest piece
+	for(size_t i = 1; steal && !job && i < m_queues.size(); ++i) {
+		Queue &victim = *m_queues[(index + i) % m_queues.size()];
+		lock_guard<mutex> lock(victim.mutex);
+
+		if(victim.jobs.size()) {
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+		}
+	}
+
+	if(job)
+		m_queued--;
+
+	return job;
+}
+
+JobHandle JobSystem::takeBackground()
+{
+	if(!m_backgroundQueued)
+		return nullptr;
+
+	JobHandle job;
+
+	{
+		lock_guard<mutex> lock(m_background.mutex);
+
+		if(m_background.jobs.size()) {
+			job = std::move(m_background.jobs.front());
+			m_background.jobs.pop_front();
+		}
+	}
+
+	if(job)
+		m_backgroundQueued--;
+
+	return job;
+}
+
+void JobSystem::runChunks(size_t chunks, const function<void(size_t)> &fn)
+{
+	atomic<size_t> next(0);
+
+	// helpers and caller pull chunks until none are left, a helper
+	// starting late finds nothing and returns
+	auto loop = [&]() {
+		for(size_t c; (c = next++) < chunks;)
+			fn(c);
+	};
+
+	size_t helpers = min(chunks, threadCount()) - 1;
+	vector<JobHandle> jobs;
+	jobs.reserve(helpers);
+
+	for(size_t i = 0; i < helpers; ++i)
+		jobs.push_back(submit(loop));
+
+	loop();
+
+	// helpers still reference loop and fn
+	wait(jobs);
+}
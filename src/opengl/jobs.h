@@ -0,0 +1,150 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace gl {
+	struct Job;
+
+	// keeps a job alive for done() and wait() and as a dependency
+	typedef std::shared_ptr<Job> JobHandle;
+
+	// Work-stealing thread pool. Every worker has a deque of its own, it
+	// pushes and pops jobs it spawns at the back and other workers steal
+	// from the front, so spawned work stays on the core whose caches it
+	// shares until someone is idle. Threads outside the pool share one
+	// more deque. A job may depend on others and runs once they have all
+	// finished, which builds continuations and whole frame task graphs.
+	// Waiting threads run jobs instead of blocking, so jobs may wait on
+	// jobs and nest parallelFor() freely. A thread outside the pool only
+	// runs jobs of the shared deque while waiting, so the GL thread never
+	// picks up a long job a worker spawned. Background jobs (asset reads)
+	// run on idle workers only.
+	class JobSystem {
+		public:
+			// 0 workers picks one per hardware thread minus the caller,
+			// and at least one
+			JobSystem(size_t workers = 0);
+
+			// runs what is still queued, then stops the workers
+			~JobSystem();
+
+			JobSystem(const JobSystem &) = delete;
+			JobSystem &operator=(const JobSystem &) = delete;
+
+			JobHandle submit(std::function<void()> fn);
+
+			// fn runs after every job of dependencies has finished
+			JobHandle submit(std::function<void()> fn,
+			const std::vector<JobHandle> &dependencies);
+
+			// fn runs after job
+			JobHandle then(const JobHandle &job, std::function<void()> fn);
+
+			// fn runs on a worker with nothing else to do, never inline in
+			// wait(), for work too long to delay a frame by
+			JobHandle submitBackground(std::function<void()> fn);
+
+			bool done(const JobHandle &job) const;
+
+			// run other jobs until job has finished
+			void wait(const JobHandle &job);
+			void wait(const std::vector<JobHandle> &jobs);
+
+			// Split [begin, end) into chunks of at least minChunk and call
+			// fn(chunkBegin, chunkEnd) on each from the pool, the calling
+			// thread included. Returns once every chunk is done.
+			template <typename F>
+			void parallelFor(size_t begin, size_t end, size_t minChunk,
+			const F &fn);
+
+			// workers plus the calling thread
+			size_t threadCount() const;
+
+			// the system OpenGLWindow created, used by ::parallelFor();
+			// nullptr when there is none
+			static JobSystem *current();
+			static void setCurrent(JobSystem *jobs);
+
+		private:
+			struct Queue {
+				std::mutex mutex;
+				std::deque<JobHandle> jobs;
+			};
+
+			// queue 0 is shared by threads outside the pool
+			std::vector<std::unique_ptr<Queue>> m_queues;
+			Queue m_background;
+			std::vector<std::thread> m_workers;
+
+			std::atomic<size_t> m_queued;
+			std::atomic<size_t> m_backgroundQueued;
+			std::atomic<size_t> m_sleeping;
+			bool m_stop = false;
+
+			std::mutex m_sleepMutex;
+			std::condition_variable m_wake;
+
+			void work(size_t index);
+			void schedule(const JobHandle &job);
+			void finish(Job &job);
+			bool runOne();
+			JobHandle take(size_t index, bool steal);
+			JobHandle takeBackground();
+			void notify();
+
+			// fn(chunk) for chunk in [0, chunks), spread over the pool
+			void runChunks(size_t chunks,
+			const std::function<void(size_t)> &fn);
+	};
+
+	struct Job {
+		std::function<void()> fn;
+
+		// unfinished dependencies, plus one while being submitted
+		std::atomic<int> dependencies;
+		std::atomic<bool> finished;
+		bool background = false;
+
+		// guards continuations and the switch to finished
+		std::mutex mutex;
+		std::vector<JobHandle> continuations;
+	};
+
+	template <typename F>
+	void JobSystem::parallelFor(size_t begin, size_t end, size_t minChunk,
+	const F &fn)
+	{
+		size_t count = end > begin ? end - begin : 0;
+
+		// a few chunks per thread balance uneven work
+		size_t chunks = std::min(count / std::max<size_t>(minChunk, 1),
+		threadCount() * 4);
+
+		if(chunks <= 1) {
+			if(count)
+				fn(begin, end);
+			return;
+		}
+
+		size_t chunk = (count + chunks - 1) / chunks;
+		chunks = (count + chunk - 1) / chunk;
+
+		runChunks(chunks, [&](size_t c) {
+			size_t b = begin + c * chunk;
+			fn(b, std::min(end, b + chunk));
+		});
+	}
+
+} // namespace gl
+
+#endif
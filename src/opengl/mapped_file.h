@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+
+namespace gl {
+	// Read only memory mapping of a whole file.
+	class MappedFile {
+		public:
+			MappedFile();
+			~MappedFile();
+
+			MappedFile(const MappedFile &) = delete;
+			MappedFile &operator=(const MappedFile &) = delete;
+
+			bool open(const std::string &path);
+			void close();
+
+			const unsigned char *data() const;
+			size_t size() const;
+			bool isOpen() const;
+
+		private:
+			const unsigned char *m_data = nullptr;
+			size_t m_size = 0;
+			bool m_open = false;
+
+#ifdef _WIN32
+			void *m_file = nullptr;
+			void *m_mapping = nullptr;
+#endif
+	};
+
+} // namespace gl
+
+#endif
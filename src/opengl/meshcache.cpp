@@ -0,0 +1,291 @@
+#include "meshcache.h"
+#include "hash.h"
+
+#include <cstdio>
+
+using namespace gl;
+using namespace std;
+
+#define COOKED_MAGIC "GLMESH\0"
+#define COOKED_VERSION 3
+#define COOKED_ALIGN 16
+
+namespace {
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint64_t sourceHash;
+		uint64_t sourceSize;
+		uint32_t meshCount;
+		uint32_t materialCount;
+		uint64_t stringsOffset;
+		uint64_t stringsSize;
+	};
+
+	struct MeshRecord {
+		uint64_t vertexOffset;
+		uint64_t vertexCount;
+		uint64_t indexOffset;
+		uint64_t indexCount;
+		float min[3];
+		float max[3];
+		float center[3];
+		float radius;
+		uint32_t firstMaterial;
+		uint32_t materialCount;
+	};
+
+	struct MaterialRecord {
+		int32_t materialId;
+		uint32_t textureOffset;
+		uint32_t textureSize;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t pad;
+	};
+}
+
+static uint64_t align(uint64_t offset)
+{
+	return (offset + COOKED_ALIGN - 1) & ~uint64_t(COOKED_ALIGN - 1);
+}
+
+bool CookedModel::open(const string &path, uint64_t sourceHash,
+uint64_t sourceSize)
+{
+	close();
+
+	if(!m_file.open(path))
+		return false;
+
+	const unsigned char *data = m_file.data();
+	size_t size = m_file.size();
+
+	if(size < sizeof(Header)) {
+		close();
+		return false;
+	}
+
+	const Header *header = (const Header*)data;
+
+	if(memcmp(header->magic, COOKED_MAGIC, 8) != 0 ||
+	header->version != COOKED_VERSION || header->vertexSize != sizeof(Vertex) ||
+	header->sourceHash != sourceHash || header->sourceSize != sourceSize) {
+		close();
+		return false;
+	}
+
+	// reject truncated or corrupted files before handing out pointers
+	uint64_t tables = sizeof(Header) + header->meshCount * sizeof(MeshRecord) +
+	header->materialCount * sizeof(MaterialRecord);
+
+	bool valid = tables <= size && header->stringsOffset >= tables &&
+	header->stringsOffset + header->stringsSize <= size;
+
+	const MeshRecord *records = (const MeshRecord*)(data + sizeof(Header));
+
+	for(uint32_t i = 0; valid && i < header->meshCount; ++i) {
+		const MeshRecord &r = records[i];
+
+		valid = r.vertexOffset + r.vertexCount * sizeof(Vertex) <= size &&
+		r.indexOffset + r.indexCount * sizeof(unsigned int) <= size &&
+		r.firstMaterial + r.materialCount <= header->materialCount;
+	}
+
+	const MaterialRecord *materials = (const MaterialRecord*)(records +
+	header->meshCount);
+
+	for(uint32_t i = 0; valid && i < header->materialCount; ++i)
+		valid = materials[i].textureOffset + materials[i].textureSize <=
+		header->stringsSize;
+
+	// submesh ranges must stay inside their mesh
+	for(uint32_t i = 0; valid && i < header->meshCount; ++i) {
+		const MeshRecord &r = records[i];
+
+		for(uint32_t m = 0; valid && m < r.materialCount; ++m) {
+			const MaterialRecord &material = materials[r.firstMaterial + m];
+			valid = (uint64_t)material.firstIndex + material.indexCount <= r.indexCount;
+		}
+	}
+
+	if(!valid) {
+		close();
+		return false;
+	}
+
+	m_meshCount = header->meshCount;
+
+	return true;
+}
+
+void CookedModel::close()
+{
+	m_file.close();
+	m_meshCount = 0;
+}
+
+size_t CookedModel::meshCount() const
+{
+	return m_meshCount;
+}
+
+CookedModel::MeshView CookedModel::mesh(size_t index) const
+{
+	const unsigned char *data = m_file.data();
+	const Header *header = (const Header*)data;
+	const MeshRecord *records = (const MeshRecord*)(data + sizeof(Header));
+	const MaterialRecord *materials = (const MaterialRecord*)(records +
+	header->meshCount);
+	const char *strings = (const char*)data + header->stringsOffset;
+
+	const MeshRecord &r = records[index];
+
+	MeshView view;
+	view.vertices = (const Vertex*)(data + r.vertexOffset);
+	view.vertexCount = r.vertexCount;
+	view.indices = (const unsigned int*)(data + r.indexOffset);
+	view.indexCount = r.indexCount;
+
+	view.volume = Volume(glm::vec3(r.min[0], r.min[1], r.min[2]),
+	glm::vec3(r.max[0], r.max[1], r.max[2]));
+	view.sphere = Sphere(glm::vec3(r.center[0], r.center[1], r.center[2]),
+	r.radius);
+
+	for(uint32_t i = 0; i < r.materialCount; ++i) {
+		const MaterialRecord &m = materials[r.firstMaterial + i];
+		view.materials.push_back({m.materialId,
+		string(strings + m.textureOffset, m.textureSize), m.firstIndex,
+		m.indexCount});
+	}
+
+	return view;
+}
+
+bool CookedModel::write(const string &path, uint64_t sourceHash,
+uint64_t sourceSize, const vector<MeshView> &meshes)
+{
+	Header header;
+	memcpy(header.magic, COOKED_MAGIC, 8);
+	header.version = COOKED_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.meshCount = meshes.size();
+	header.materialCount = 0;
+
+	vector<MeshRecord> records;
+	vector<MaterialRecord> materials;
+	string strings;
+
+	for(const MeshView &mesh : meshes) {
+		MeshRecord r;
+		r.vertexCount = mesh.vertexCount;
+		r.indexCount = mesh.indexCount;
+
+		for(int i = 0; i < 3; ++i) {
+			r.min[i] = mesh.volume.min[i];
+			r.max[i] = mesh.volume.max[i];
+			r.center[i] = mesh.sphere.center[i];
+		}
+		r.radius = mesh.sphere.radius;
+
+		r.firstMaterial = materials.size();
+		r.materialCount = mesh.materials.size();
+
+		for(const MaterialRef &ref : mesh.materials) {
+			MaterialRecord m;
+			m.materialId = ref.materialId;
+			m.textureOffset = strings.size();
+			m.textureSize = ref.diffuseTexture.size();
+			m.firstIndex = ref.firstIndex;
+			m.indexCount = ref.indexCount;
+			m.pad = 0;
+
+			strings += ref.diffuseTexture;
+			materials.push_back(m);
+		}
+
+		records.push_back(r);
+	}
+
+	header.materialCount = materials.size();
+	header.stringsOffset = sizeof(Header) + records.size() * sizeof(MeshRecord) +
+	materials.size() * sizeof(MaterialRecord);
+	header.stringsSize = strings.size();
+
+	// blobs follow the strings, aligned for direct uploads
+	uint64_t offset = align(header.stringsOffset + header.stringsSize);
+
+	for(size_t i = 0; i < meshes.size(); ++i) {
+		records[i].vertexOffset = offset;
+		offset = align(offset + meshes[i].vertexCount * sizeof(Vertex));
+
+		records[i].indexOffset = offset;
+		offset = align(offset + meshes[i].indexCount * sizeof(unsigned int));
+	}
+
+	// write next to the destination and rename, readers never see a
+	// partially written file
+	string tmpPath = path + ".tmp";
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+
+	if(!file)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(Header), 1, file) == 1;
+
+	if(records.size())
+		ok = ok && fwrite(records.data(), sizeof(MeshRecord), records.size(), file) == records.size();
+	if(materials.size())
+		ok = ok && fwrite(materials.data(), sizeof(MaterialRecord), materials.size(), file) == materials.size();
+	if(strings.size())
+		ok = ok && fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+
+	static const char zeros[COOKED_ALIGN] = {};
+	uint64_t written = header.stringsOffset + header.stringsSize;
+
+	for(size_t i = 0; ok && i < meshes.size(); ++i) {
+		const MeshView &mesh = meshes[i];
+		const MeshRecord &r = records[i];
+
+		ok = fwrite(zeros, 1, r.vertexOffset - written, file) == r.vertexOffset - written;
+		ok = ok && fwrite(mesh.vertices, sizeof(Vertex), mesh.vertexCount, file) == mesh.vertexCount;
+		written = r.vertexOffset + mesh.vertexCount * sizeof(Vertex);
+
+		ok = ok && fwrite(zeros, 1, r.indexOffset - written, file) == r.indexOffset - written;
+		ok = ok && fwrite(mesh.indices, sizeof(unsigned int), mesh.indexCount, file) == mesh.indexCount;
+		written = r.indexOffset + mesh.indexCount * sizeof(unsigned int);
+	}
+
+	ok = fclose(file) == 0 && ok;
+
+	if(ok) {
+		remove(path.c_str());
+		ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+
+	if(!ok)
+		remove(tmpPath.c_str());
+
+	return ok;
+}
+
+string CookedModel::pathFor(const string &sourcePath)
+{
+	return sourcePath + ".cooked";
+}
+
+bool CookedModel::hashFile(const string &path, uint64_t &hash, uint64_t &size)
+{
+	MappedFile file;
+
+	if(!file.open(path))
+		return false;
+
+	hash = hashBytes(file.data(), file.size());
+	size = file.size();
+
+	return true;
+}
@@ -0,0 +1,65 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "opengl.h"
+#include "mapped_file.h"
+
+namespace gl {
+	// Cooked binary copy of a parsed model, stored next to its source as
+	// <source>.cooked. Vertex and index blobs are stored in their GPU
+	// layout so a memory mapped file can be uploaded without copies.
+	//
+	// layout: header | mesh records | material refs | strings | blobs
+	class CookedModel {
+		public:
+			struct MeshView {
+				const Vertex *vertices;
+				size_t vertexCount;
+				const unsigned int *indices;
+				size_t indexCount;
+
+				Volume volume;
+				Sphere sphere;
+
+				std::vector<MaterialRef> materials;
+			};
+
+			// map path and validate it against the source content hash
+			bool open(const std::string &path, uint64_t sourceHash,
+			uint64_t sourceSize);
+			void close();
+
+			size_t meshCount() const;
+			MeshView mesh(size_t index) const;
+
+			static bool write(const std::string &path, uint64_t sourceHash,
+			uint64_t sourceSize, const std::vector<MeshView> &meshes);
+
+			static std::string pathFor(const std::string &sourcePath);
+
+			// content hash of a whole file, false if it can not be read
+			static bool hashFile(const std::string &path, uint64_t &hash,
+			uint64_t &size);
+
+		private:
+			MappedFile m_file;
+			size_t m_meshCount = 0;
+	};
+
+	// CPU side of a model load, see Model::read(). Meshes either point
+	// into the cooked file mapping or into the vectors parsed from source.
+	struct ModelData {
+			CookedModel cooked;
+			std::vector<CookedModel::MeshView> meshes;
+
+			std::vector<std::vector<Vertex>> vertices;
+			std::vector<std::vector<unsigned int>> indices;
+	};
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,103 @@
+#include "normal_matrix.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define NORMAL_MATRIX_SSE
+#endif
+
+using namespace gl;
+using namespace glm;
+
+// determinants smaller than this are treated as singular
+#define SINGULAR_EPSILON 1e-20f
+
+// inverse transpose of [a b c] is [b x c, c x a, a x b] / det
+static inline void normalMatrix(const mat4 &m, NormalMatrix &out)
+{
+	vec3 a(m[0]), b(m[1]), c(m[2]);
+	vec3 bc = cross(b, c), ca = cross(c, a), ab = cross(a, b);
+
+	float det = dot(a, bc);
+	float inv = fabsf(det) > SINGULAR_EPSILON ? 1.0f / det : 1.0f;
+
+	out.columns[0] = vec4(bc * inv, 0.0f);
+	out.columns[1] = vec4(ca * inv, 0.0f);
+	out.columns[2] = vec4(ab * inv, 0.0f);
+}
+
+void gl::computeNormalMatrices(const mat4 *models, size_t count,
+NormalMatrix *out)
+{
+	size_t i = 0;
+
+#ifdef NORMAL_MATRIX_SSE
+	const __m128 epsilon = _mm_set1_ps(SINGULAR_EPSILON);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+
+	for(; i + 4 <= count; i += 4) {
+		// columns of four matrices transposed to x, y and z of each
+		__m128 col[3][4];
+
+		for(int j = 0; j < 3; ++j) {
+			__m128 r0 = _mm_loadu_ps(&models[i][j][0]);
+			__m128 r1 = _mm_loadu_ps(&models[i + 1][j][0]);
+			__m128 r2 = _mm_loadu_ps(&models[i + 2][j][0]);
+			__m128 r3 = _mm_loadu_ps(&models[i + 3][j][0]);
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+			col[j][0] = r0;
+			col[j][1] = r1;
+			col[j][2] = r2;
+			col[j][3] = _mm_setzero_ps();
+		}
+
+		__m128 (&a)[4] = col[0];
+		__m128 (&b)[4] = col[1];
+		__m128 (&c)[4] = col[2];
+
+		// cross products of column pairs
+		__m128 r[3][4];
+
+		r[0][0] = _mm_sub_ps(_mm_mul_ps(b[1], c[2]), _mm_mul_ps(b[2], c[1]));
+		r[0][1] = _mm_sub_ps(_mm_mul_ps(b[2], c[0]), _mm_mul_ps(b[0], c[2]));
+		r[0][2] = _mm_sub_ps(_mm_mul_ps(b[0], c[1]), _mm_mul_ps(b[1], c[0]));
+
+		r[1][0] = _mm_sub_ps(_mm_mul_ps(c[1], a[2]), _mm_mul_ps(c[2], a[1]));
+		r[1][1] = _mm_sub_ps(_mm_mul_ps(c[2], a[0]), _mm_mul_ps(c[0], a[2]));
+		r[1][2] = _mm_sub_ps(_mm_mul_ps(c[0], a[1]), _mm_mul_ps(c[1], a[0]));
+
+		r[2][0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+		r[2][1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+		r[2][2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], r[0][0]),
+		_mm_mul_ps(a[1], r[0][1])), _mm_mul_ps(a[2], r[0][2]));
+
+		// exact division, normals keep their length through the matrix
+		__m128 singular = _mm_cmple_ps(_mm_andnot_ps(sign, det), epsilon);
+		__m128 inv = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(singular, one),
+		_mm_andnot_ps(singular, det)));
+
+		for(int j = 0; j < 3; ++j) {
+			__m128 x = _mm_mul_ps(r[j][0], inv);
+			__m128 y = _mm_mul_ps(r[j][1], inv);
+			__m128 z = _mm_mul_ps(r[j][2], inv);
+			__m128 w = _mm_setzero_ps();
+
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+
+			_mm_storeu_ps(&out[i].columns[j][0], x);
+			_mm_storeu_ps(&out[i + 1].columns[j][0], y);
+			_mm_storeu_ps(&out[i + 2].columns[j][0], z);
+			_mm_storeu_ps(&out[i + 3].columns[j][0], w);
+		}
+	}
+#endif
+
+	for(; i < count; ++i)
+		normalMatrix(models[i], out[i]);
+}
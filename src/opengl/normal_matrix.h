@@ -0,0 +1,27 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// first of the three attribute locations of the per instance normal
+// matrix, after the model matrix at 4 to 7
+#define NORMAL_MATRIX_LOCATION 8
+
+namespace gl {
+	// inverse transpose of the upper 3x3 of a model matrix, one column per
+	// vec4 so the instance attribute reads aligned vec3s (w unused)
+	struct NormalMatrix {
+		glm::vec4 columns[3];
+	};
+
+	// out[i] = transpose(inverse(mat3(models[i]))), four matrices per SSE
+	// step. Singular matrices give their cofactor matrix instead of
+	// infinities.
+	void computeNormalMatrices(const glm::mat4 *models, size_t count,
+	NormalMatrix *out);
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,793 @@
+#include "objparser.h"
+#include "mapped_file.h"
+#include "parallel.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <sstream>
+
+using namespace gl;
+using namespace std;
+using namespace tinyobj;
+
+// smallest chunk worth a thread of its own
+#define OBJ_MIN_CHUNK (256 * 1024)
+
+namespace {
+	enum Op { FACES, LINE, POINTS, USEMTL, MTLLIB, GROUP, OBJECT, SMOOTH, FAIL };
+
+	struct Command {
+		Op op;
+		size_t first;
+		size_t count;
+		size_t line; // 1 based, local to the chunk
+		std::string text;
+	};
+
+	struct Face {
+		size_t first;
+		size_t count;
+	};
+
+	// relative (negative) indices are resolved against chunk local counts
+	// and fixed up once the counts of previous chunks are known
+	struct Relative {
+		size_t vertex;
+		unsigned char mask;
+	};
+
+	struct Chunk {
+		const char *begin;
+		const char *end;
+
+		std::vector<real_t> v, vn, vt, vc;
+		std::vector<vertex_index_t> verts;
+		std::vector<Face> faces;
+		std::vector<Relative> relative;
+		std::vector<Command> commands;
+
+		size_t lines = 0;
+		int greatestV = -1, greatestVn = -1, greatestVt = -1;
+	};
+
+	// faces referenced by the group being built
+	struct Group {
+		struct Prim {
+			const vertex_index_t *verts;
+			size_t count;
+			unsigned int smoothing;
+		};
+
+		std::vector<Prim> faces;
+		std::vector<Prim> lines;
+		std::vector<Prim> points;
+
+		bool empty() const { return faces.empty() && lines.empty() && points.empty(); }
+		void clear() { faces.clear(); lines.clear(); points.clear(); }
+	};
+}
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline const char *skipSpace(const char *p, const char *end)
+{
+	while(p < end && isSpace(*p))
+		++p;
+	return p;
+}
+
+// strcspn(p, " \t\r") bounded by end
+static inline const char *skipToken(const char *p, const char *end)
+{
+	while(p < end && !isSpace(*p) && *p != '\r')
+		++p;
+	return p;
+}
+
+// atoi bounded by end
+static inline int parseInt(const char *p, const char *end)
+{
+	while(p < end && (isSpace(*p) || *p == '\r' || *p == '\n' || *p == '\v' || *p == '\f'))
+		++p;
+
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	int value = 0;
+	while(p < end && (unsigned)(*p - '0') < 10)
+		value = value * 10 + (*p++ - '0');
+
+	return negative ? -value : value;
+}
+
+// parse one float token, accepting the same leading grammar as tinyobj
+static inline bool tryParseReal(const char *&p, const char *end, real_t &out)
+{
+	p = skipSpace(p, end);
+	const char *tokenEnd = skipToken(p, end);
+	const char *s = p;
+
+	p = tokenEnd;
+
+	if(s < tokenEnd && *s == '+')
+		++s;
+
+	const char *digits = s < tokenEnd && *s == '-' ? s + 1 : s;
+
+	if(digits >= tokenEnd || ((unsigned)(*digits - '0') >= 10 && *digits != '.'))
+		return false;
+
+	// no locale, no allocation; parsed as double then narrowed like tinyobj
+	double value;
+	from_chars_result res = from_chars(s, tokenEnd, value);
+
+	if(res.ec != errc() || res.ptr == s)
+		return false;
+
+	out = (real_t)value;
+	return true;
+}
+
+static inline real_t parseReal(const char *&p, const char *end, real_t fallback)
+{
+	real_t value;
+	return tryParseReal(p, end, value) ? value : fallback;
+}
+
+static inline bool fixIndex(int idx, int n, int &ret, bool &relative)
+{
+	relative = idx < 0;
+
+	if(idx > 0) {
+		ret = idx - 1;
+		return true;
+	}
+
+	if(idx < 0) {
+		ret = n + idx;
+		return true;
+	}
+
+	// zero is not allowed according to the spec
+	return false;
+}
+
+static inline const char *skipIndex(const char *p, const char *end)
+{
+	while(p < end && *p != '/' && !isSpace(*p) && *p != '\r')
+		++p;
+	return p;
+}
+
+// i, i/j/k, i//k, i/j
+static bool parseTriple(const char *&p, const char *end, Chunk &chunk,
+vertex_index_t &vi)
+{
+	int vsize = chunk.v.size() / 3;
+	int vnsize = chunk.vn.size() / 3;
+	int vtsize = chunk.vt.size() / 2;
+
+	bool relative;
+	unsigned char mask = 0;
+
+	vi = vertex_index_t(-1);
+
+	if(!fixIndex(parseInt(p, end), vsize, vi.v_idx, relative))
+		return false;
+	mask |= relative ? 1 : 0;
+
+	p = skipIndex(p, end);
+
+	if(p < end && *p == '/') {
+		++p;
+
+		if(p < end && *p == '/') {
+			++p;
+			if(!fixIndex(parseInt(p, end), vnsize, vi.vn_idx, relative))
+				return false;
+			mask |= relative ? 4 : 0;
+			p = skipIndex(p, end);
+		} else {
+			if(!fixIndex(parseInt(p, end), vtsize, vi.vt_idx, relative))
+				return false;
+			mask |= relative ? 2 : 0;
+			p = skipIndex(p, end);
+
+			if(p < end && *p == '/') {
+				++p;
+				if(!fixIndex(parseInt(p, end), vnsize, vi.vn_idx, relative))
+					return false;
+				mask |= relative ? 4 : 0;
+				p = skipIndex(p, end);
+			}
+		}
+	}
+
+	if(mask)
+		chunk.relative.push_back({chunk.verts.size(), mask});
+
+	return true;
+}
+
+// parse the vertex list of an f, l or p line, false on invalid indices
+static bool parseElement(const char *p, const char *end, Chunk &chunk,
+size_t &first, size_t &count)
+{
+	first = chunk.verts.size();
+
+	p = skipSpace(p, end);
+
+	while(p < end && *p != '\r') {
+		vertex_index_t vi;
+
+		if(!parseTriple(p, end, chunk, vi))
+			return false;
+
+		chunk.verts.push_back(vi);
+
+		while(p < end && (isSpace(*p) || *p == '\r'))
+			++p;
+	}
+
+	count = chunk.verts.size() - first;
+
+	return true;
+}
+
+static inline bool startsWith(const char *p, const char *end, const char *word,
+size_t len)
+{
+	return size_t(end - p) > len && memcmp(p, word, len) == 0 && isSpace(p[len]);
+}
+
+static void pushCommand(Chunk &chunk, Op op, size_t first, size_t count,
+string text = string())
+{
+	chunk.commands.push_back({op, first, count, chunk.lines, text});
+}
+
+static void parseLine(const char *p, const char *end, Chunk &chunk)
+{
+	p = skipSpace(p, end);
+
+	if(p >= end || *p == '#')
+		return;
+
+	char c0 = *p;
+	char c1 = p + 1 < end ? p[1] : '\0';
+	char c2 = p + 2 < end ? p[2] : '\0';
+
+	// vertex, with optional color
+	if(c0 == 'v' && isSpace(c1)) {
+		p += 2;
+
+		real_t x = parseReal(p, end, 0.0f);
+		real_t y = parseReal(p, end, 0.0f);
+		real_t z = parseReal(p, end, 0.0f);
+
+		real_t r, g, b;
+		if(!(tryParseReal(p, end, r) && tryParseReal(p, end, g) && tryParseReal(p, end, b)))
+			r = g = b = 1.0f;
+
+		chunk.v.insert(chunk.v.end(), {x, y, z});
+		chunk.vc.insert(chunk.vc.end(), {r, g, b});
+		return;
+	}
+
+	if(c0 == 'v' && c1 == 'n' && isSpace(c2)) {
+		p += 3;
+
+		real_t x = parseReal(p, end, 0.0f);
+		real_t y = parseReal(p, end, 0.0f);
+		real_t z = parseReal(p, end, 0.0f);
+
+		chunk.vn.insert(chunk.vn.end(), {x, y, z});
+		return;
+	}
+
+	if(c0 == 'v' && c1 == 't' && isSpace(c2)) {
+		p += 3;
+
+		real_t x = parseReal(p, end, 0.0f);
+		real_t y = parseReal(p, end, 0.0f);
+
+		chunk.vt.insert(chunk.vt.end(), {x, y});
+		return;
+	}
+
+	if(c0 == 'f' && isSpace(c1)) {
+		size_t first, count;
+
+		if(!parseElement(p + 2, end, chunk, first, count)) {
+			pushCommand(chunk, FAIL, 'f', 0);
+			return;
+		}
+
+		// consecutive faces share one command
+		if(chunk.commands.empty() || chunk.commands.back().op != FACES)
+			pushCommand(chunk, FACES, chunk.faces.size(), 0);
+
+		chunk.faces.push_back({first, count});
+		chunk.commands.back().count++;
+
+		for(size_t i = first; i < first + count; ++i) {
+			const vertex_index_t &vi = chunk.verts[i];
+			chunk.greatestV = std::max(chunk.greatestV, vi.v_idx);
+			chunk.greatestVn = std::max(chunk.greatestVn, vi.vn_idx);
+			chunk.greatestVt = std::max(chunk.greatestVt, vi.vt_idx);
+		}
+		return;
+	}
+
+	if((c0 == 'l' || c0 == 'p') && isSpace(c1)) {
+		size_t first, count;
+
+		if(!parseElement(p + 2, end, chunk, first, count))
+			pushCommand(chunk, FAIL, c0, 0);
+		else
+			pushCommand(chunk, c0 == 'l' ? LINE : POINTS, first, count);
+		return;
+	}
+
+	if(startsWith(p, end, "usemtl", 6)) {
+		pushCommand(chunk, USEMTL, 0, 0, string(p + 7, end));
+		return;
+	}
+
+	if(startsWith(p, end, "mtllib", 6)) {
+		pushCommand(chunk, MTLLIB, 0, 0, string(p + 7, end));
+		return;
+	}
+
+	if(c0 == 'g' && isSpace(c1)) {
+		// names are space separated tokens, the first one being `g'
+		vector<string> names;
+
+		while(p < end && *p != '\r') {
+			p = skipSpace(p, end);
+			const char *e = skipToken(p, end);
+			names.push_back(string(p, e));
+			p = e;
+
+			while(p < end && (isSpace(*p) || *p == '\r'))
+				++p;
+		}
+
+		string name;
+		for(size_t i = 1; i < names.size(); ++i)
+			name += (i > 1 ? " " : "") + names[i];
+
+		pushCommand(chunk, GROUP, 0, names.size(), name);
+		return;
+	}
+
+	if(c0 == 'o' && isSpace(c1)) {
+		pushCommand(chunk, OBJECT, 0, 0, string(p + 2, end));
+		return;
+	}
+
+	if(c0 == 's' && isSpace(c1)) {
+		p = skipSpace(p + 2, end);
+
+		if(p >= end || *p == '\r' || (p + 1 < end && p[1] == '\n'))
+			return;
+
+		if(end - p >= 3) {
+			if(p[0] == 'o' && p[1] == 'f' && p[2] == 'f')
+				pushCommand(chunk, SMOOTH, 0, 0);
+		} else {
+			int id = parseInt(p, end);
+			pushCommand(chunk, SMOOTH, id < 0 ? 0 : id, 0);
+		}
+		return;
+	}
+
+	// unknown commands, including `t', are ignored
+}
+
+static void parseChunk(Chunk &chunk)
+{
+	const char *p = chunk.begin;
+
+	while(p < chunk.end) {
+		const char *lineEnd = p;
+		while(lineEnd < chunk.end && *lineEnd != '\n' && *lineEnd != '\r')
+			++lineEnd;
+
+		chunk.lines++;
+
+		parseLine(p, lineEnd, chunk);
+
+		// stop at the first error, later lines are never reached
+		if(chunk.commands.size() && chunk.commands.back().op == FAIL)
+			return;
+
+		// \n, \r\n or a lone \r end a line
+		p = lineEnd;
+		if(p < chunk.end && *p == '\r')
+			++p;
+		if(p < chunk.end && *p == '\n')
+			++p;
+	}
+}
+
+static bool exportGroup(shape_t *shape, const Group &group, int material,
+const string &name, const vector<real_t> &v)
+{
+	if(group.empty())
+		return false;
+
+	shape->name = name;
+
+	vector<tag_t> tags;
+	mesh_t &mesh = shape->mesh;
+
+	for(const Group::Prim &face : group.faces) {
+		if(face.count < 3)
+			continue;
+
+		// triangles come out of the triangulator unchanged, skip it
+		if(face.count == 3) {
+			for(size_t k = 0; k < 3; ++k) {
+				index_t idx;
+				idx.vertex_index = face.verts[k].v_idx;
+				idx.normal_index = face.verts[k].vn_idx;
+				idx.texcoord_index = face.verts[k].vt_idx;
+				mesh.indices.push_back(idx);
+			}
+
+			mesh.num_face_vertices.push_back(3);
+			mesh.material_ids.push_back(material);
+			mesh.smoothing_group_ids.push_back(face.smoothing);
+			continue;
+		}
+
+		PrimGroup polygon;
+		polygon.faceGroup.resize(1);
+		polygon.faceGroup[0].smoothing_group_id = face.smoothing;
+		polygon.faceGroup[0].vertex_indices.assign(face.verts,
+		face.verts + face.count);
+
+		exportGroupsToShape(shape, polygon, tags, material, name, true, v);
+	}
+
+	if(group.lines.size() || group.points.size()) {
+		PrimGroup prims;
+
+		for(const Group::Prim &line : group.lines) {
+			prims.lineGroup.push_back(__line_t());
+			prims.lineGroup.back().vertex_indices.assign(line.verts,
+			line.verts + line.count);
+		}
+
+		for(const Group::Prim &points : group.points) {
+			prims.pointsGroup.push_back(__points_t());
+			prims.pointsGroup.back().vertex_indices.assign(points.verts,
+			points.verts + points.count);
+		}
+
+		exportGroupsToShape(shape, prims, tags, material, name, true, v);
+	}
+
+	return true;
+}
+
+bool ObjParser::parseFromFile(const string &path)
+{
+	auto start = chrono::steady_clock::now();
+
+	m_attrib = attrib_t();
+	m_shapes.clear();
+	m_materials.clear();
+	m_warning.clear();
+	m_error.clear();
+	m_bytes = 0;
+	m_seconds = 0;
+
+	MappedFile file;
+
+	if(!file.open(path)) {
+		m_error = "Cannot open file [" + path + "]\n";
+		return false;
+	}
+
+	const char *data = (const char*)file.data();
+	size_t size = file.size();
+
+	// split in line aligned chunks, one per thread
+	size_t threads = std::max(1u, thread::hardware_concurrency());
+	size_t chunkCount = std::max<size_t>(1, std::min(threads, size / OBJ_MIN_CHUNK));
+
+	vector<Chunk> chunks(chunkCount);
+	const char *begin = data;
+
+	for(size_t i = 0; i < chunkCount; ++i) {
+		const char *end = i + 1 == chunkCount ? data + size :
+		std::max(begin, data + size * (i + 1) / chunkCount);
+
+		while(end < data + size && end > data && end[-1] != '\n')
+			++end;
+
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+		begin = end;
+	}
+
+	parallelFor(0, chunkCount, 1, [&](size_t b, size_t e) {
+		for(size_t i = b; i < e; ++i)
+			parseChunk(chunks[i]);
+	});
+
+	// attribute offsets of every chunk
+	vector<size_t> vOffset(chunkCount + 1, 0), vnOffset(chunkCount + 1, 0);
+	vector<size_t> vtOffset(chunkCount + 1, 0), lineOffset(chunkCount + 1, 0);
+
+	for(size_t i = 0; i < chunkCount; ++i) {
+		vOffset[i + 1] = vOffset[i] + chunks[i].v.size();
+		vnOffset[i + 1] = vnOffset[i] + chunks[i].vn.size();
+		vtOffset[i + 1] = vtOffset[i] + chunks[i].vt.size();
+		lineOffset[i + 1] = lineOffset[i] + chunks[i].lines;
+	}
+
+	m_attrib.vertices.resize(vOffset[chunkCount]);
+	m_attrib.colors.resize(vOffset[chunkCount]);
+	m_attrib.normals.resize(vnOffset[chunkCount]);
+	m_attrib.texcoords.resize(vtOffset[chunkCount]);
+
+	// concatenate attributes and make indices absolute
+	parallelFor(0, chunkCount, 1, [&](size_t b, size_t e) {
+		for(size_t i = b; i < e; ++i) {
+			Chunk &chunk = chunks[i];
+
+			std::copy(chunk.v.begin(), chunk.v.end(), m_attrib.vertices.begin() + vOffset[i]);
+			std::copy(chunk.vc.begin(), chunk.vc.end(), m_attrib.colors.begin() + vOffset[i]);
+			std::copy(chunk.vn.begin(), chunk.vn.end(), m_attrib.normals.begin() + vnOffset[i]);
+			std::copy(chunk.vt.begin(), chunk.vt.end(), m_attrib.texcoords.begin() + vtOffset[i]);
+
+			int v = vOffset[i] / 3, vn = vnOffset[i] / 3, vt = vtOffset[i] / 2;
+
+			for(const Relative &r : chunk.relative) {
+				vertex_index_t &vi = chunk.verts[r.vertex];
+
+				if(r.mask & 1)
+					vi.v_idx += v;
+				if(r.mask & 2)
+					vi.vt_idx += vt;
+				if(r.mask & 4)
+					vi.vn_idx += vn;
+			}
+
+			// recompute for faces using relative indices
+			if(chunk.relative.size()) {
+				chunk.greatestV = chunk.greatestVn = chunk.greatestVt = -1;
+
+				for(const Face &face : chunk.faces) {
+					for(size_t k = face.first; k < face.first + face.count; ++k) {
+						chunk.greatestV = std::max(chunk.greatestV, chunk.verts[k].v_idx);
+						chunk.greatestVn = std::max(chunk.greatestVn, chunk.verts[k].vn_idx);
+						chunk.greatestVt = std::max(chunk.greatestVt, chunk.verts[k].vt_idx);
+					}
+				}
+			}
+
+			chunk.v = vector<real_t>();
+			chunk.vc = vector<real_t>();
+			chunk.vn = vector<real_t>();
+			chunk.vt = vector<real_t>();
+		}
+	});
+
+	// replay state changes in file order
+	string baseDir;
+	if(path.find_last_of("/\\") != string::npos) {
+#ifndef _WIN32
+		const char dirsep = '/';
+#else
+		const char dirsep = '\\';
+#endif
+		baseDir = path.substr(0, path.find_last_of("/\\")) + dirsep;
+	}
+
+	MaterialFileReader materialReader(baseDir);
+	map<string, int> materialMap;
+
+	const vector<real_t> &v = m_attrib.vertices;
+	int material = -1;
+	unsigned int smoothing = 0;
+	string name;
+
+	shape_t shape;
+	Group group;
+
+	int greatestV = -1, greatestVn = -1, greatestVt = -1;
+
+	for(size_t c = 0; c < chunkCount; ++c) {
+		Chunk &chunk = chunks[c];
+
+		greatestV = std::max(greatestV, chunk.greatestV);
+		greatestVn = std::max(greatestVn, chunk.greatestVn);
+		greatestVt = std::max(greatestVt, chunk.greatestVt);
+
+		for(const Command &cmd : chunk.commands) {
+			size_t line = lineOffset[c] + cmd.line;
+
+			switch(cmd.op) {
+			case FACES:
+				for(size_t f = cmd.first; f < cmd.first + cmd.count; ++f) {
+					const Face &face = chunk.faces[f];
+					group.faces.push_back({&chunk.verts[face.first], face.count,
+					smoothing});
+				}
+				break;
+
+			case LINE:
+				group.lines.push_back({&chunk.verts[cmd.first], cmd.count, 0});
+				break;
+
+			case POINTS:
+				group.points.push_back({&chunk.verts[cmd.first], cmd.count, 0});
+				break;
+
+			case SMOOTH:
+				smoothing = cmd.first;
+				break;
+
+			case USEMTL: {
+				auto it = materialMap.find(cmd.text);
+				int newMaterial = it != materialMap.end() ? it->second : -1;
+
+				if(newMaterial != material) {
+					exportGroup(&shape, group, material, name, v);
+					group.faces.clear();
+					material = newMaterial;
+				}
+				break;
+			}
+
+			case MTLLIB: {
+				vector<string> filenames;
+				SplitString(cmd.text, ' ', filenames);
+
+				if(filenames.empty()) {
+					stringstream ss;
+					ss << "Looks like empty filename for mtllib. Use default "
+					"material (line " << line << ".)\n";
+					m_warning += ss.str();
+					break;
+				}
+
+				bool found = false;
+
+				for(const string &filename : filenames) {
+					string warn, err;
+					bool ok = materialReader(filename, &m_materials, &materialMap,
+					&warn, &err);
+
+					m_warning += warn;
+					m_error += err;
+
+					if(ok) {
+						found = true;
+						break;
+					}
+				}
+
+				if(!found)
+					m_warning += "Failed to load material file(s). Use default "
+					"material.\n";
+				break;
+			}
+
+			case GROUP:
+				exportGroup(&shape, group, material, name, v);
+
+				if(shape.mesh.indices.size())
+					m_shapes.push_back(shape);
+
+				shape = shape_t();
+				group.clear();
+
+				if(cmd.count < 2) {
+					stringstream ss;
+					ss << "Empty group name. line: " << line << "\n";
+					m_warning += ss.str();
+				}
+
+				name = cmd.text;
+				break;
+
+			case OBJECT:
+				if(exportGroup(&shape, group, material, name, v))
+					m_shapes.push_back(shape);
+
+				group.clear();
+				shape = shape_t();
+				name = cmd.text;
+				break;
+
+			case FAIL: {
+				stringstream ss;
+				ss << "Failed parse `" << (char)cmd.first << "' line(e.g. zero value for "
+				<< (cmd.first == 'f' ? "face" : "vertex") << " index. line " << line << ".)\n";
+				m_error += ss.str();
+				return false;
+			}
+			}
+		}
+	}
+
+	size_t lines = lineOffset[chunkCount];
+
+	if(greatestV >= (int)(v.size() / 3)) {
+		stringstream ss;
+		ss << "Vertex indices out of bounds (line " << lines << ".)\n" << endl;
+		m_warning += ss.str();
+	}
+	if(greatestVn >= (int)(m_attrib.normals.size() / 3)) {
+		stringstream ss;
+		ss << "Vertex normal indices out of bounds (line " << lines << ".)\n" << endl;
+		m_warning += ss.str();
+	}
+	if(greatestVt >= (int)(m_attrib.texcoords.size() / 2)) {
+		stringstream ss;
+		ss << "Vertex texcoord indices out of bounds (line " << lines << ".)\n" << endl;
+		m_warning += ss.str();
+	}
+
+	// a trailing usemtl leaves the group empty, keep what was exported
+	if(exportGroup(&shape, group, material, name, v) || shape.mesh.indices.size())
+		m_shapes.push_back(shape);
+
+	m_bytes = size;
+	m_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	return true;
+}
+
+const attrib_t &ObjParser::attrib() const
+{
+	return m_attrib;
+}
+
+const vector<shape_t> &ObjParser::shapes() const
+{
+	return m_shapes;
+}
+
+const vector<material_t> &ObjParser::materials() const
+{
+	return m_materials;
+}
+
+const string &ObjParser::warning() const
+{
+	return m_warning;
+}
+
+const string &ObjParser::error() const
+{
+	return m_error;
+}
+
+size_t ObjParser::bytes() const
+{
+	return m_bytes;
+}
+
+double ObjParser::seconds() const
+{
+	return m_seconds;
+}
+
+double ObjParser::megabytesPerSecond() const
+{
+	return m_seconds > 0 ? m_bytes / (1024.0 * 1024.0) / m_seconds : 0;
+}
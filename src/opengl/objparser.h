@@ -0,0 +1,46 @@
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include <string>
+#include <vector>
+
+#include "tiny_obj_loader.h"
+
+namespace gl {
+	// Wavefront OBJ parser producing the same attrib/shape/material output
+	// and error messages as tinyobj::ObjReader with its default config.
+	// The file is memory mapped and split in line aligned chunks that are
+	// tokenized in parallel; chunk results are then stitched together in
+	// order, which only replays state changes (groups, materials) and
+	// triangulates. `t' (subdivision tag) lines are ignored.
+	class ObjParser {
+		public:
+			bool parseFromFile(const std::string &path);
+
+			const tinyobj::attrib_t &attrib() const;
+			const std::vector<tinyobj::shape_t> &shapes() const;
+			const std::vector<tinyobj::material_t> &materials() const;
+
+			const std::string &warning() const;
+			const std::string &error() const;
+
+			// size of the last parsed file and time spent on it
+			size_t bytes() const;
+			double seconds() const;
+			double megabytesPerSecond() const;
+
+		private:
+			tinyobj::attrib_t m_attrib;
+			std::vector<tinyobj::shape_t> m_shapes;
+			std::vector<tinyobj::material_t> m_materials;
+
+			std::string m_warning;
+			std::string m_error;
+
+			size_t m_bytes = 0;
+			double m_seconds = 0;
+	};
+
+} // namespace gl
+
+#endif
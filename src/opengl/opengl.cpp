@@ -1,63 +1,176 @@
 #include "opengl.h"
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include "bounds.h"
+#include "meshcache.h"
+#include "objparser.h"
+#include "welder.h"
+#include "parallel.h"
+#include "hash.h"
+#include "asset_loader.h"
+#include "program_cache.h"
+#include "shader_library.h"
+#include "normal_matrix.h"
+#include "texture_atlas.h"
 
 #define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <chrono>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
 using namespace gl;
 using namespace std;
 using namespace glm;
 
+// instances per thread when computing normal matrices
+#define NORMAL_MIN_INSTANCES 16384
+
+// fixed steps simulated in one frame at most, the rest of a long frame
+// is dropped
+#define MAX_FIXED_STEPS 8
+
+// milliseconds a lazy loop sleeps before checking for work again
+#define IDLE_TIMEOUT 500
+
+FrameStats &gl::frameStats()
+{
+	static FrameStats stats;
+	return stats;
+}
+
+// copy data into buffer at offset, through the staging ring when it fits
+static void uploadBytes(unsigned int buffer, size_t offset, const void *data,
+size_t size)
+{
+	if(!stagingRing().upload(buffer, offset, data, size)) {
+		glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	frameStats().bytesUploaded += size;
+	frameStats().uploads++;
+}
+
+// upload dirty element ranges of data into buffer
+static void uploadRanges(unsigned int buffer, DirtyRanges &ranges,
+const void *data, size_t elementSize)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+
+	for(const DirtyRanges::Range &range : ranges.ranges()) {
+		size_t offset = range.begin * elementSize;
+		uploadBytes(buffer, offset, bytes + offset, range.size() * elementSize);
+	}
+
+	ranges.clear();
+}
+
+// grow buffer to hold count elements, returns true if it was reallocated
+// and filled with data
+static bool reserveBuffer(unsigned int buffer, size_t &capacity, size_t count,
+const void *data, size_t elementSize)
+{
+	if(count <= capacity)
+		return false;
+
+	glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, count * elementSize, data, GL_DYNAMIC_DRAW);
+	glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	capacity = count;
+
+	frameStats().bytesUploaded += count * elementSize;
+	frameStats().uploads++;
+
+	return true;
+}
+
 Shader::Shader() {}
 
 Shader::Shader(const char *vertexPath, const char *fragmentPath)
 {
-	addFromFile(GL_VERTEX_SHADER, vertexPath);
-	addFromFile(GL_FRAGMENT_SHADER, fragmentPath);
-	link();
+	string vertex, fragment;
+	preprocessShader(vertexPath, {}, vertex);
+	preprocessShader(fragmentPath, {}, fragment);
+
+	// the driver's own binary from an earlier run, when still accepted
+	string cachePath = programCachePath(vertexPath, fragmentPath);
+	uint64_t key = programKey({vertex, fragment});
+
+	m_program = loadProgramBinary(cachePath, key);
+
+	if(m_program) {
+		reflect();
+		return;
+	}
+
+	addFromSource(GL_VERTEX_SHADER, vertex.c_str());
+	addFromSource(GL_FRAGMENT_SHADER, fragment.c_str());
+
+	if(link() && !saveProgramBinary(cachePath, key, m_program))
+		cerr << "Unable to write program cache " << cachePath << endl;
+}
+
+Shader::Shader(unsigned int program) : m_program(program)
+{
+	reflect();
 }
 
 unsigned int Shader::program() { return m_program; }
 
-void Shader::setMat4(const string &name, const mat4 &value)
+int Shader::uniform(UniformKey key) const
 {
-	glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, value_ptr(value));
+	auto it = lower_bound(m_uniforms.begin(), m_uniforms.end(),
+	make_pair(key, INT_MIN));
+
+	return it != m_uniforms.end() && it->first == key ? it->second : -1;
 }
 
-void Shader::setMat3(const string &name, const mat3 &value)
+void Shader::setMat4(int location, const mat4 &value)
 {
-	glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, value_ptr(value));
+	glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
-void Shader::setInt(const string &name, const int &value)
+void Shader::setMat3(int location, const mat3 &value)
 {
-	glUniform1i(uniformLocation(name), value);
+	glUniformMatrix3fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
-void gl::Shader::setFloat(const std::string &name, const float &value)
+void Shader::setInt(int location, const int &value)
 {
-	glUniform1f(uniformLocation(name), value);
+	glUniform1i(location, value);
 }
 
-bool Shader::addFromFile(int type, const char *path)
+void Shader::setFloat(int location, const float &value)
 {
-	ifstream t(path);
-	stringstream buffer;
+	glUniform1f(location, value);
+}
 
-	buffer << t.rdbuf();
+void Shader::setMat4(const string &name, const mat4 &value)
+{
+	setMat4(uniform(fnv1a(name.c_str())), value);
+}
 
-	string src = buffer.str();
+void Shader::setMat3(const string &name, const mat3 &value)
+{
+	setMat3(uniform(fnv1a(name.c_str())), value);
+}
 
-	return addFromSource(type, src.c_str());
+void Shader::setInt(const string &name, const int &value)
+{
+	setInt(uniform(fnv1a(name.c_str())), value);
+}
+
+void Shader::setFloat(const string &name, const float &value)
+{
+	setFloat(uniform(fnv1a(name.c_str())), value);
 }
 
 bool Shader::addFromSource(int type, const char *src)
@@ -93,6 +206,9 @@ bool Shader::link()
 {
 	m_program = glCreateProgram();
 
+	// allow glGetProgramBinary() for the program cache
+	glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	glAttachShader(m_program, m_vertex);
 	glAttachShader(m_program, m_fragment);
 	glLinkProgram(m_program);
@@ -109,45 +225,66 @@ bool Shader::link()
 	glDeleteShader(m_vertex);
 	glDeleteShader(m_fragment);
 
+	if(res)
+		reflect();
+
 	return res;
 }
 
-int Shader::uniformLocation(const string &name)
+void Shader::reflect()
 {
-	auto it = m_uniforms.find(name);
+	int count, maxLength;
+	glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	vector<char> name(maxLength + 1);
+	m_uniforms.clear();
 
-	if(it == m_uniforms.end()) {
-		int location = glGetUniformLocation(program(), name.c_str());
-		it = m_uniforms.insert(make_pair(name, location)).first;
+	for(int i = 0; i < count; ++i) {
+		int size;
+		GLenum type;
+		glGetActiveUniform(m_program, i, name.size(), nullptr, &size, &type,
+		name.data());
+
+		// block members have no location of their own
+		int location = glGetUniformLocation(m_program, name.data());
+
+		if(location < 0)
+			continue;
+
+		// "lights[0]" is looked up as "lights"
+		if(char *bracket = strchr(name.data(), '['))
+			*bracket = 0;
+
+		m_uniforms.push_back(make_pair(fnv1a(name.data()), location));
 	}
 
-	return it->second;
-}
+	sort(m_uniforms.begin(), m_uniforms.end());
 
-Texture::Texture(unsigned int id, const char *type, const char *path) :
-id(id), type(type), path(path)
-{
+	unsigned int frame = glGetUniformBlockIndex(m_program, "Frame");
 
+	if(frame != GL_INVALID_INDEX)
+		glUniformBlockBinding(m_program, frame, FRAME_UNIFORM_BINDING);
 }
 
-Texture Texture::loadFromPath(const char *path, const char *type)
+Texture::Texture(unsigned int id, const char *type, const char *path,
+TextureHandle handle) : id(id), handle(handle),
+type(textureCache().intern(type)), path(textureCache().intern(path))
 {
-	stbi_set_flip_vertically_on_load(true);
 
-	int w, h, ch;
-	unsigned char* image = stbi_load(path, &w, &h, &ch, 0);
-
-	if(!image) {
-		cerr << "Unable to load texture: " << path << endl;
-		exit(1);
-	}
+}
 
-	Texture text = loadFromImage(image, w, h, ch, type);
-	text.path = path;
+unsigned int Texture::glId() const
+{
+	return handle ? textureCache().glId(handle) : id;
+}
 
-	stbi_image_free(image);
+Texture Texture::loadFromPath(const char *path, const char *type)
+{
+	TextureCache &cache = textureCache();
+	TextureHandle handle = cache.acquire(path);
 
-	return text;
+	return Texture(cache.glId(handle), type, cache.path(handle), handle);
 }
 
 Texture Texture::loadFromImage(unsigned char *image, int w, int h, int ch, const char *type)
@@ -155,7 +292,7 @@ Texture Texture::loadFromImage(unsigned char *image, int w, int h, int ch, const
 	unsigned int id;
 
 	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
+	glState().bindTexture(GL_TEXTURE_2D, id);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -165,7 +302,7 @@ Texture Texture::loadFromImage(unsigned char *image, int w, int h, int ch, const
 	else if (ch == 4)
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glState().bindTexture(GL_TEXTURE_2D, 0);
 
 	return Texture(id, type, "");
 }
@@ -186,6 +323,25 @@ textures(textures)
 	setup();
 }
 
+Mesh::Mesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices,
+size_t indexCount, vector<Texture> textures, const Volume &volume,
+const Sphere &sphere) :
+textures(textures),
+volume(volume),
+sphere(sphere)
+{
+	setupBuffers(vertices, vertexCount, indices, indexCount, GL_STATIC_DRAW);
+}
+
+Mesh::Mesh(size_t vertexCount, size_t indexCount, vector<Texture> textures,
+const Volume &volume, const Sphere &sphere) :
+textures(textures),
+volume(volume),
+sphere(sphere)
+{
+	setupBuffers(nullptr, vertexCount, nullptr, indexCount, GL_STATIC_DRAW);
+}
+
 Mesh::~Mesh()
 {
 
@@ -194,73 +350,261 @@ Mesh::~Mesh()
 void Mesh::cleanup()
 {
     if (VAO) {
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
-        glDeleteBuffers(1, &intancesVBO);
-        glDeleteVertexArrays(1, &VAO);
+        glState().deleteBuffers(1, &VBO);
+        glState().deleteBuffers(1, &EBO);
+        glState().deleteBuffers(1, &intancesVBO);
+        glState().deleteBuffers(1, &normalsVBO);
+        glState().deleteVertexArrays(1, &VAO);
     }
+
+	for(const Texture &texture : textures)
+		textureCache().release(texture.handle);
+}
+
+void Mesh::markVerticesDirty(size_t first, size_t count)
+{
+	dirtyVertices.mark(first, count);
+}
+
+void Mesh::markIndicesDirty(size_t first, size_t count)
+{
+	dirtyIndices.mark(first, count);
 }
 
 void Mesh::updateVBO()
 {
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof(Vertex) * vertices.size(),
-	&vertices[0] );
+	// a buffer filled from a raw pointer has nothing to update from
+	assert(vertices.size() || !vertexCapacity);
+
+	if(reserveBuffer(VBO, vertexCapacity, vertices.size(), vertices.data(),
+	sizeof(Vertex))) {
+		dirtyVertices.clear();
+		return;
+	}
+
+	if(dirtyVertices.empty())
+		dirtyVertices.markAll(vertices.size());
+
+	dirtyVertices.clamp(vertices.size());
+	uploadRanges(VBO, dirtyVertices, vertices.data(), sizeof(Vertex));
+}
+
+void Mesh::updateEBO()
+{
+	assert(indices.size() || !indexCapacity);
+
+	elements = indices.size();
+
+	if(reserveBuffer(EBO, indexCapacity, indices.size(), indices.data(),
+	sizeof(unsigned int))) {
+		dirtyIndices.clear();
+		return;
+	}
+
+	if(dirtyIndices.empty())
+		dirtyIndices.markAll(indices.size());
+
+	dirtyIndices.clamp(indices.size());
+	uploadRanges(EBO, dirtyIndices, indices.data(), sizeof(unsigned int));
 }
 
-void Mesh::updateInstancesVBO(glm::mat4 *instances, size_t count)
+void Mesh::updateInstancesVBO(const glm::mat4 *instances, size_t count)
 {
 	// remember number of bytes allocated last call, use glBufferSubdata if possible
 	// https://www.roxlu.com/2014/028/opengl-instanced-rendering
-	glBindBuffer(GL_ARRAY_BUFFER, intancesVBO);
+	glState().bindBuffer(GL_ARRAY_BUFFER, intancesVBO);
 
 	size_t mat4size = sizeof(mat4);
 
-    if(count != instancesDrawn) {
-        glBufferData( GL_ARRAY_BUFFER, mat4size * instancesDrawn,
+    if(count != instancesCapacity) {
+        glBufferData( GL_ARRAY_BUFFER, mat4size * instancesCapacity,
 		nullptr, GL_STREAM_DRAW );
         glBufferData( GL_ARRAY_BUFFER, mat4size * count,
         instances, GL_STREAM_DRAW );
-        instancesDrawn = count;
+        instancesCapacity = count;
 	} else {
         glBufferSubData( GL_ARRAY_BUFFER, 0, mat4size * count,
         instances );
 	}
+
+	instancesDrawn = count;
+
+	frameStats().bytesUploaded += mat4size * count;
+	frameStats().uploads++;
+
+	glState().bindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+
+	if(count > normalsCapacity) {
+		glBufferData(GL_ARRAY_BUFFER, sizeof(NormalMatrix) * count, nullptr,
+		GL_STREAM_DRAW);
+		normalsCapacity = count;
+	}
+
+	if(count) {
+		NormalMatrix *dst = (NormalMatrix*)glMapBufferRange(GL_ARRAY_BUFFER, 0,
+		sizeof(NormalMatrix) * count,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+		if(dst) {
+			parallelFor(0, count, NORMAL_MIN_INSTANCES, [&](size_t begin,
+			size_t end) {
+				computeNormalMatrices(instances + begin, end - begin, dst + begin);
+			});
+
+			if(!glUnmapBuffer(GL_ARRAY_BUFFER))
+				instancesDrawn = 0;
+		}
+	}
+
+	frameStats().bytesUploaded += sizeof(NormalMatrix) * instancesDrawn;
+	frameStats().uploads++;
+}
+
+size_t Mesh::updateInstancesVBO(const glm::mat4 *instances, size_t count,
+const Frustum &frustum)
+{
+	size_t mat4size = sizeof(mat4);
+
+	glState().bindBuffer(GL_ARRAY_BUFFER, intancesVBO);
+
+	// only grow, the visible count changes every frame
+	if(count > instancesCapacity) {
+		glBufferData(GL_ARRAY_BUFFER, mat4size * count, nullptr, GL_STREAM_DRAW);
+		instancesCapacity = count;
+	}
+
+	instancesDrawn = 0;
+
+	if(count) {
+		// cull straight into the orphaned buffer storage
+		mat4 *dst = (mat4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, mat4size * count,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+		// and the normal matrices of the survivors next to them
+		glState().bindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+
+		if(count > normalsCapacity) {
+			glBufferData(GL_ARRAY_BUFFER, sizeof(NormalMatrix) * count, nullptr,
+			GL_STREAM_DRAW);
+			normalsCapacity = count;
+		}
+
+		NormalMatrix *normals = (NormalMatrix*)glMapBufferRange(GL_ARRAY_BUFFER,
+		0, sizeof(NormalMatrix) * count,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+		size_t visible = 0;
+
+		if(dst && normals)
+			visible = culler.cull(instances, count, volume, frustum, dst, normals);
+
+		// contents are undefined if a mapping got lost, skip a frame
+		bool normalsOk = !normals || glUnmapBuffer(GL_ARRAY_BUFFER);
+
+		glState().bindBuffer(GL_ARRAY_BUFFER, intancesVBO);
+
+		if(dst && glUnmapBuffer(GL_ARRAY_BUFFER) && normalsOk)
+			instancesDrawn = visible;
+	}
+
+	frameStats().bytesUploaded += (mat4size + sizeof(NormalMatrix)) *
+	instancesDrawn;
+	frameStats().uploads++;
+	frameStats().instancesVisible += instancesDrawn;
+	frameStats().instancesCulled += count - instancesDrawn;
+
+	return instancesDrawn;
+}
+
+size_t Mesh::instanceCount() const
+{
+	return instancesDrawn;
+}
+
+size_t Mesh::indexCount() const
+{
+	return elements;
+}
+
+void Mesh::draw()
+{
+	// left bound afterwards, glState() drops the rebind when the next
+	// draw uses the same vertex array or texture
+	glState().bindVertexArray(VAO);
+	glState().activeTexture(GL_TEXTURE0);
+
+	if(submeshes.empty()) {
+		if(textures.size())
+			glState().bindTexture(GL_TEXTURE_2D, textures[0].glId());
+
+		glDrawElementsInstanced(GL_TRIANGLES, elements, GL_UNSIGNED_INT,
+		nullptr, instancesDrawn);
+	}
+
+	for(const SubMesh &submesh : submeshes) {
+		if(submesh.texture >= 0)
+			glState().bindTexture(GL_TEXTURE_2D, textures[submesh.texture].glId());
+
+		glDrawElementsInstanced(GL_TRIANGLES, submesh.indexCount,
+		GL_UNSIGNED_INT, (void*)(submesh.firstIndex * sizeof(unsigned int)),
+		instancesDrawn);
+	}
+}
+
+void Mesh::keepCpuData(const Vertex *vertexData, size_t vertexCount,
+const unsigned int *indexData, size_t indexCount)
+{
+	vertices.assign(vertexData, vertexData + vertexCount);
+	indices.assign(indexData, indexData + indexCount);
+}
+
+void Mesh::uploadVertices(const Vertex *data, size_t first, size_t count)
+{
+	uploadBytes(VBO, first * sizeof(Vertex), data, count * sizeof(Vertex));
+}
+
+void Mesh::uploadIndices(const unsigned int *data, size_t first, size_t count)
+{
+	uploadBytes(EBO, first * sizeof(unsigned int), data,
+	count * sizeof(unsigned int));
 }
 
 void Mesh::setup()
 {
 	// compute volume
-	vec3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
-	vec3 max = {FLT_MIN, FLT_MIN, FLT_MIN};
+	computeBounds(&vertices.data()->pos, vertices.size(), sizeof(Vertex),
+	volume, sphere);
 
-	for(Vertex v : vertices) {
-		min[0] = fminf(min[0], v.pos[0]);
-		min[1] = fminf(min[1], v.pos[1]);
-		min[2] = fminf(min[2], v.pos[2]);
+	setupBuffers(vertices.data(), vertices.size(), indices.data(), indices.size(),
+	GL_DYNAMIC_DRAW);
+}
 
-		max[0] = fmaxf(max[0], v.pos[0]);
-		max[1] = fmaxf(max[1], v.pos[1]);
-		max[2] = fmaxf(max[2], v.pos[2]);
-	}
+void Mesh::setupBuffers(const Vertex *vertexData, size_t vertexCount,
+const unsigned int *indexData, size_t indexCount, GLenum usage)
+{
+	elements = indexCount;
+	vertexCapacity = vertexCount;
+	indexCapacity = indexCount;
 
-    volume = Volume(min, max);
+	// merge ranges less than 4KB apart into a single upload
+	dirtyVertices.setMergeGap(4096 / sizeof(Vertex));
+	dirtyIndices.setMergeGap(4096 / sizeof(unsigned int));
 
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &EBO);
 	glGenBuffers(1, &intancesVBO);
+	glGenBuffers(1, &normalsVBO);
 
 	// bind VAO
-	glBindVertexArray(VAO);
+	glState().bindVertexArray(VAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-	&vertices[0], GL_STATIC_DRAW);
+	glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, usage);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-	&indices[0], GL_STATIC_DRAW);
+	glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int),
+	indexData, usage);
 
 	// vertex positions
 	glEnableVertexAttribArray(0);
@@ -282,7 +626,7 @@ void Mesh::setup()
 	(void*)offsetof(Vertex, texCoords));
 
 	// set vertex attribute for instance matrices
-    glBindBuffer(GL_ARRAY_BUFFER, intancesVBO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, intancesVBO);
     glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
 
 	size_t location = 4;
@@ -301,8 +645,20 @@ void Mesh::setup()
 		offset += vec4size;
 	}
 
+	// normal matrices, locations 8 to 10, one vec4 column per location
+	glState().bindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+	glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+
+	for(size_t i = 0; i < 3; ++i) {
+		glEnableVertexAttribArray(NORMAL_MATRIX_LOCATION + i);
+		glVertexAttribPointer(NORMAL_MATRIX_LOCATION + i, 3, GL_FLOAT, GL_FALSE,
+		sizeof(NormalMatrix), (void*)(i * vec4size));
+
+		glVertexAttribDivisor(NORMAL_MATRIX_LOCATION + i, 1);
+	}
+
 	// unbind VAO
-	glBindVertexArray(0);
+	glState().bindVertexArray(0);
 
 	std::cout << "created\n";
 }
@@ -311,7 +667,9 @@ Model::Model() {}
 
 Model::Model(const vector<Mesh> &meshes) : meshes(meshes) {}
 
-Model::Model(const string &path) : m_path(path)
+Model::Model(const string &path, float weldEpsilon, bool keepCpuData,
+TextureAtlas *atlas) : m_path(path), m_weldEpsilon(weldEpsilon),
+m_keepCpuData(keepCpuData), m_atlas(atlas)
 {
 	load(path);
 }
@@ -336,175 +694,684 @@ string Model::pathFromFileName(const string &fileName)
 	return path;
 }
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
-
-namespace std
+// materials and texture names from the mtllib files end up in the
+// cooked file too, so their content is part of the cache key
+uint64_t Model::hashMaterialFiles(const string &path, uint64_t hash)
 {
-	template<> struct hash<Vertex>
-	{
-			size_t operator()(Vertex const& vertex) const
-			{
-				return ((hash<vec3>()(vertex.pos) ^
-				(hash<vec3>()(vertex.normal) << 1)) >> 1) ^
-				(hash<vec3>()(vertex.color) << 1);
+	MappedFile file;
+
+	if(!file.open(path))
+		return hash;
+
+	string directory = pathFromFileName(path);
+	const char *p = (const char*)file.data();
+	const char *end = p + file.size();
+
+	while(p < end) {
+		const char *eol = (const char*)memchr(p, '\n', end - p);
+
+		if(!eol)
+			eol = end;
+
+		while(p < eol && (*p == ' ' || *p == '\t'))
+			++p;
+
+		if(eol - p > 6 && !memcmp(p, "mtllib", 6) && (p[6] == ' ' || p[6] == '\t')) {
+			for(p += 7; p < eol; ) {
+				const char *name = p;
+
+				while(p < eol && !isspace((unsigned char)*p))
+					++p;
+
+				// a missing file hashes as zero, adding it later still
+				// changes the key
+				uint64_t mtlHash = 0, mtlSize = 0;
+
+				if(p > name)
+					CookedModel::hashFile(directory + string(name, p), mtlHash,
+					mtlSize);
+
+				hash = mix64(hash ^ mtlHash);
+
+				while(p < eol && isspace((unsigned char)*p))
+					++p;
 			}
-	};
+		}
+
+		p = eol + 1;
+	}
+
+	return hash;
 }
 
 void Model::load(const string &path)
 {
-	tinyobj::ObjReader reader;
+	ModelData data;
 
-	if(!reader.ParseFromFile(path)) {
-		cerr << "Unable to load model from " << path << " : " << reader.Error() << endl;
+	if(!read(path, m_weldEpsilon, data))
 		exit(1);
+
+	create(data);
+}
+
+bool Model::read(const string &path, float weldEpsilon, ModelData &data)
+{
+	uint64_t sourceHash, sourceSize;
+	string cookedPath = CookedModel::pathFor(path);
+
+	bool hashed = CookedModel::hashFile(path, sourceHash, sourceSize);
+
+	if(hashed)
+		sourceHash = hashMaterialFiles(path, sourceHash);
+
+	// welded output depends on the epsilon, so does the cache
+	if(weldEpsilon > 0.0f) {
+		uint32_t bits;
+		memcpy(&bits, &weldEpsilon, sizeof(bits));
+		sourceHash = mix64(sourceHash ^ bits);
 	}
 
-	string texturePath = pathFromFileName(path);
-	vector<Texture> allTextures;
+	if(!hashed || !readCooked(cookedPath, sourceHash, sourceSize, data)) {
+		if(!readObj(path, weldEpsilon, data))
+			return false;
+
+		if(hashed && !CookedModel::write(cookedPath, sourceHash, sourceSize,
+		data.meshes))
+			cerr << "Unable to write model cache " << cookedPath << endl;
+	}
+
+	// texture names are stored relative to the model, the cooked file
+	// stays valid whatever path it is opened through
+	string directory = pathFromFileName(path);
+
+	for(CookedModel::MeshView &view : data.meshes) {
+		for(MaterialRef &ref : view.materials) {
+			if(ref.diffuseTexture.size())
+				ref.diffuseTexture = directory + ref.diffuseTexture;
+		}
+	}
+
+	return true;
+}
 
-	// Loop over shapes
-	for(size_t s = 0; s < reader.GetShapes().size(); s++) {
-		// Loop over faces(polygon)
-		size_t index_offset = 0;
+void Model::create(const ModelData &data)
+{
+	// small textures go onto the atlas pages, those meshes are built
+	// from a copy with remapped texture coordinates
+	vector<vector<AtlasHandle>> handles(data.meshes.size());
+	vector<vector<Vertex>> packedVertices(data.meshes.size());
+	vector<vector<unsigned int>> packedIndices(data.meshes.size());
+
+	for(size_t m = 0; m_atlas && m < data.meshes.size(); ++m) {
+		const CookedModel::MeshView &view = data.meshes[m];
+
+		m_atlas->pack(view.materials, view.vertices, view.vertexCount,
+		view.indices, view.indexCount, handles[m], packedVertices[m],
+		packedIndices[m]);
+	}
 
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
+	// textures load one at a time, see texture_read_batch in bench/ for
+	// why not through TextureCache::acquireBatch()
+	for(size_t m = 0; m < data.meshes.size(); ++m) {
+		const CookedModel::MeshView &view = data.meshes[m];
 		vector<Texture> textures;
+		vector<SubMesh> submeshes;
+
+		createMaterials(view.materials, textures, submeshes, nullptr, m_atlas,
+		&handles[m]);
+
+		// buffers are filled straight from the mapped file or parsed data
+		const Vertex *vertices = view.vertices;
+		size_t vertexCount = view.vertexCount;
+		const unsigned int *indices = view.indices;
+		size_t indexCount = view.indexCount;
+
+		if(packedVertices[m].size()) {
+			vertices = packedVertices[m].data();
+			vertexCount = packedVertices[m].size();
+			indices = packedIndices[m].data();
+			indexCount = packedIndices[m].size();
+		}
+
+		meshes.push_back(Mesh(vertices, vertexCount, indices, indexCount,
+		textures, view.volume, view.sphere));
+		meshes.back().submeshes = submeshes;
 
-		unordered_map<Vertex, size_t> uniqueVertices;
+		if(m_keepCpuData)
+			meshes.back().keepCpuData(vertices, vertexCount, indices, indexCount);
+
+		cout << "Loaded Mesh with " << view.vertexCount << " verts and " << view.volume << " Volume" << endl;
+	}
+}
 
-		for(size_t f = 0; f < reader.GetShapes()[s].mesh.num_face_vertices.size(); f++) {
+void Model::createMaterials(const vector<MaterialRef> &materials,
+vector<Texture> &textures, vector<SubMesh> &submeshes, AssetLoader *loader,
+const TextureAtlas *atlas, const vector<AtlasHandle> *atlasHandles)
+{
+	for(size_t m = 0; m < materials.size(); ++m) {
+		const MaterialRef &ref = materials[m];
+		AtlasHandle handle = atlas && atlasHandles &&
+		m < atlasHandles->size() ? (*atlasHandles)[m] : 0;
+		int texture = -1;
+
+		if(handle) {
+			// materials on the same page share its texture
+			Texture page = atlas->texture(handle, "texture_diffuse");
+			texture = 0;
+
+			while(texture < (int)textures.size() && textures[texture].id != page.id)
+				texture++;
+
+			if(texture == (int)textures.size())
+				textures.push_back(page);
+		} else if(ref.diffuseTexture.size()) {
+			texture = textures.size();
+			textures.push_back(loader ?
+			loader->loadTexture(ref.diffuseTexture.c_str(), "texture_diffuse") :
+			Texture::loadFromPath(ref.diffuseTexture.c_str(), "texture_diffuse"));
+		}
 
-			size_t fv = reader.GetShapes()[s].mesh.num_face_vertices[f];
+		submeshes.push_back({ref.firstIndex, ref.indexCount, ref.materialId,
+		texture});
+	}
+}
 
-			// Loop over vertices in the face.
-			for(size_t v = 0; v < fv; v++) {
-				// access to vertex
-				tinyobj::index_t idx = reader.GetShapes()[s].mesh.indices[index_offset + v];
+bool Model::readCooked(const string &path, uint64_t sourceHash,
+uint64_t sourceSize, ModelData &data)
+{
+	if(!data.cooked.open(path, sourceHash, sourceSize))
+		return false;
 
-				tinyobj::real_t vx = reader.GetAttrib().vertices[3*idx.vertex_index+0];
-				tinyobj::real_t vy = reader.GetAttrib().vertices[3*idx.vertex_index+1];
-				tinyobj::real_t vz = reader.GetAttrib().vertices[3*idx.vertex_index+2];
+	for(size_t i = 0; i < data.cooked.meshCount(); ++i)
+		data.meshes.push_back(data.cooked.mesh(i));
 
-				tinyobj::real_t nx = reader.GetAttrib().normals[3*idx.normal_index+0];
-				tinyobj::real_t ny = reader.GetAttrib().normals[3*idx.normal_index+1];
-				tinyobj::real_t nz = reader.GetAttrib().normals[3*idx.normal_index+2];
+	return true;
+}
 
-				tinyobj::real_t tx = reader.GetAttrib().texcoords[2*idx.texcoord_index+0];
-				tinyobj::real_t ty = reader.GetAttrib().texcoords[2*idx.texcoord_index+1];
+bool Model::readObj(const string &path, float weldEpsilon, ModelData &data)
+{
+	// parse and weld time shows in the profiler, the parse rate is
+	// ObjParser::megabytesPerSecond()
+	PROFILE_SCOPE("read obj");
 
-				// Optional: vertex colors
-				tinyobj::real_t red = reader.GetAttrib().colors[3*idx.vertex_index+0];
-				tinyobj::real_t green = reader.GetAttrib().colors[3*idx.vertex_index+1];
-				tinyobj::real_t blue = reader.GetAttrib().colors[3*idx.vertex_index+2];
+	ObjParser parser;
 
+	if(!parser.parseFromFile(path)) {
+		cerr << "Unable to load model from " << path << " : " << parser.error() << endl;
+		return false;
+	}
+
+	const vector<tinyobj::shape_t> &shapes = parser.shapes();
+	const tinyobj::attrib_t &attrib = parser.attrib();
+
+	data.vertices.resize(shapes.size());
+	data.indices.resize(shapes.size());
+	data.meshes.resize(shapes.size());
+
+	// weld and bound shapes in parallel
+	parallelFor(0, shapes.size(), 1, [&](size_t begin, size_t end) {
+		for(size_t s = begin; s < end; ++s) {
+			const tinyobj::mesh_t &mesh = shapes[s].mesh;
+			VertexWelder welder(weldEpsilon);
+			vector<unsigned int> welded;
+
+			welder.reserve(mesh.indices.size(), attrib.vertices.size() / 3);
+			welded.reserve(mesh.indices.size());
+
+			for(const tinyobj::index_t &idx : mesh.indices) {
 				Vertex vertex;
 
-				vertex.pos = {vx, vy, vz}; // pos
-				vertex.normal = {nx, ny, nz}; // normal
-				vertex.color = {red, green, blue}; // color
-				vertex.texCoords = {tx, ty}; // texCoords
+				vertex.pos = {attrib.vertices[3*idx.vertex_index+0],
+				attrib.vertices[3*idx.vertex_index+1],
+				attrib.vertices[3*idx.vertex_index+2]};
 
-				if(uniqueVertices.count(vertex) == 0) {
-					uniqueVertices[vertex] = vertices.size();
-					vertices.push_back(vertex);
-				}
+				vertex.normal = {attrib.normals[3*idx.normal_index+0],
+				attrib.normals[3*idx.normal_index+1],
+				attrib.normals[3*idx.normal_index+2]};
 
-				indices.push_back(uniqueVertices[vertex]);
+				vertex.color = {attrib.colors[3*idx.vertex_index+0],
+				attrib.colors[3*idx.vertex_index+1],
+				attrib.colors[3*idx.vertex_index+2]};
+
+				vertex.texCoords = {attrib.texcoords[2*idx.texcoord_index+0],
+				attrib.texcoords[2*idx.texcoord_index+1]};
+
+				welded.push_back(welder.insert(vertex));
 			}
 
-			index_offset += fv;
+			CookedModel::MeshView &view = data.meshes[s];
+
+			// materials in first use order and the number of indices of each
+			vector<size_t> faceMaterial(mesh.material_ids.size());
 
-			// TODO: read per-face material
-			size_t materialId = reader.GetShapes()[s].mesh.material_ids[f];
-			string diffuseTexture = texturePath + reader.GetMaterials()[materialId].diffuse_texname;
+			for(size_t f = 0; f < mesh.material_ids.size(); f++) {
+				int materialId = mesh.material_ids[f];
+				size_t m = 0;
 
-			bool textureLoaded = false;
+				while(m < view.materials.size() &&
+				view.materials[m].materialId != materialId)
+					m++;
 
-			for(size_t i = 0; i < allTextures.size(); ++i) {
-				if(strcmp(allTextures[i].path.data(), diffuseTexture.c_str()) == 0) {
-					textureLoaded = true;
-					textures.push_back(allTextures[i]);
-					break;
+				if(m == view.materials.size()) {
+					string diffuseTexture;
+
+					if(materialId >= 0 && (size_t)materialId < parser.materials().size() &&
+					parser.materials()[materialId].diffuse_texname.size())
+						diffuseTexture = parser.materials()[materialId].diffuse_texname;
+
+					view.materials.push_back({materialId, diffuseTexture, 0, 0});
 				}
+
+				faceMaterial[f] = m;
+				view.materials[m].indexCount += mesh.num_face_vertices[f];
 			}
 
-			if(!textureLoaded) {
-				Texture texture = Texture::loadFromPath(diffuseTexture.c_str(), "texture_diffuse");
-				allTextures.push_back(texture);
-				textures.push_back(texture);
+			for(size_t m = 1; m < view.materials.size(); m++)
+				view.materials[m].firstIndex = view.materials[m - 1].firstIndex +
+				view.materials[m - 1].indexCount;
+
+			// scatter faces into one contiguous range per material
+			vector<unsigned int> &indices = data.indices[s];
+			vector<size_t> cursor(view.materials.size());
+
+			indices.resize(welded.size());
+
+			for(size_t m = 0; m < view.materials.size(); m++)
+				cursor[m] = view.materials[m].firstIndex;
+
+			for(size_t f = 0, corner = 0; f < faceMaterial.size(); f++) {
+				size_t fv = mesh.num_face_vertices[f];
+
+				std::copy(welded.begin() + corner, welded.begin() + corner + fv,
+				indices.begin() + cursor[faceMaterial[f]]);
+
+				cursor[faceMaterial[f]] += fv;
+				corner += fv;
 			}
-		}
 
-		Mesh mesh(vertices, indices, textures);
-		meshes.push_back(mesh);
+			vector<Vertex> &vertices = data.vertices[s];
+			vertices.swap(welder.vertices());
 
-        cout << "Loaded Mesh with " << vertices.size() << " verts and " << mesh.volume << " Volume" << endl;
-	}
+			view.vertices = vertices.data();
+			view.vertexCount = vertices.size();
+			view.indices = indices.data();
+			view.indexCount = indices.size();
+
+			computeBounds(&vertices.data()->pos, vertices.size(), sizeof(Vertex),
+			view.volume, view.sphere);
+		}
+	});
+
+	return true;
 }
 
-OpenGLWindow::OpenGLWindow() : m_running(false), m_open(true)
+OpenGLWindow::OpenGLWindow(const WindowOptions &options) :
+m_options(options), m_lazy(options.lazyRedraw), m_redrawFrames(1),
+m_wakePending(false), m_running(false), m_open(true)
 {
-	SDL_Init(SDL_INIT_VIDEO);
+	width = options.width;
+	height = options.height;
+
+	if(options.headless) {
+		SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER);
+
+#ifdef ENABLE_HEADLESS
+		if(!m_headless.create(4, 5))
+			exit(1);
+#else
+		cerr << "Built without headless support, see ENABLE_HEADLESS" << endl;
+		exit(1);
+#endif
+	} else {
+		SDL_Init(SDL_INIT_VIDEO);
 
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
 
-	width = 800;
-	height = 600;
+		m_window = SDL_CreateWindow("window", 100, 100, width, height,
+		SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+		m_context = SDL_GL_CreateContext(m_window);
 
-	m_window = SDL_CreateWindow("window", 100, 100, width, height,
-	SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
-	m_context = SDL_GL_CreateContext(m_window);
+		setSwapInterval(SWAP_VSYNC);
+	}
 
     glewExperimental = GL_TRUE;
     GLenum glewError = glewInit();
+
+	// an EGL context has no GLX display, the GL entry points are loaded
+	// all the same
+	if(options.headless && glewError == GLEW_ERROR_NO_GLX_DISPLAY)
+		glewError = GLEW_OK;
+
     if( glewError != GLEW_OK ) {
        printf( "Error initializing GLEW! %s\n", glewGetErrorString( glewError ) );
     }
 
+	if(options.headless) {
+		if(!m_framebuffer.create(width, height))
+			exit(1);
+
+		m_framebuffer.bind();
+		glViewport(0, 0, width, height);
+
+		cout << "Headless " << width << "x" << height << " on " <<
+		glGetString(GL_RENDERER) << endl;
+	}
+
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-	glEnable(GL_DEPTH_TEST);
+	glState().enable(GL_DEPTH_TEST);
+
+	m_wakeEvent = SDL_RegisterEvents(1);
+	m_mainThread = this_thread::get_id();
+
+	m_jobs = new JobSystem;
+	JobSystem::setCurrent(m_jobs);
 
 	m_scene = new OpenGLScene;
+	m_atlas = new TextureAtlas;
+	m_assets = new AssetLoader(*m_jobs);
+	m_assets->setAtlas(m_atlas);
+	m_shaders = new ShaderLibrary;
 }
 
 OpenGLWindow::~OpenGLWindow()
 {
 	delete m_scene;
 
-	SDL_GL_DeleteContext(m_context);
-	SDL_DestroyWindow(m_window);
+	m_shaders->clear();
+	delete m_shaders;
+
+	if(m_frameUBO)
+		glState().deleteBuffers(1, &m_frameUBO);
+
+	// reads go first, pending uploads need the context
+	delete m_assets;
+
+	m_atlas->clear();
+	delete m_atlas;
+
+	stagingRing().release();
+	textureCache().clear();
+	profiler().release();
+	m_framebuffer.release();
+
+	// after everything that may still run jobs
+	JobSystem::setCurrent(nullptr);
+	delete m_jobs;
+
+	if(m_options.headless) {
+#ifdef ENABLE_HEADLESS
+		m_headless.destroy();
+#endif
+	} else {
+		SDL_GL_DeleteContext(m_context);
+		SDL_DestroyWindow(m_window);
+	}
+
 	SDL_Quit();
 }
 
 void OpenGLWindow::setTitle(const char *title)
 {
-	SDL_SetWindowTitle(m_window, title);
+	if(m_window)
+		SDL_SetWindowTitle(m_window, title);
 }
 
 void OpenGLWindow::run()
 {
 	m_running = true;
 
-	m_elapsed = SDL_GetTicks();
+	m_clock.reset();
+	m_accumulator = 0.0;
+
+	uint64_t frame = 0;
+
+	// no window events will tell the size
+	if(m_options.headless)
+		sizeChanged(width, height);
+
+	m_reading = m_ready = -1;
+	m_simulatedFrames = 0;
+
+	if(m_options.simulationThread)
+		m_simulation = thread(&OpenGLWindow::simulationLoop, this);
 
 	while(m_running) {
-		processEvents();
+		if(m_lazy && !m_options.headless && !waitForRedraw())
+			continue;
+
+		// requests made while drawing this frame are for the next one
+		if(m_redrawFrames > 0)
+			m_redrawFrames--;
+
+		profiler().beginFrame();
+
+		{
+			PROFILE_SCOPE("events");
+			processEvents();
+		}
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		uint32_t time = SDL_GetTicks();
-		m_lag = time - m_elapsed;
+		double dt = m_clock.tick();
+
+		const FramePacket *packet;
+
+		if(m_options.simulationThread) {
+			PROFILE_SCOPE("wait");
+			packet = acquirePacket();
+		} else {
+			simulateFrame(m_packets[0], dt);
+			packet = &m_packets[0];
+		}
+
+		{
+			PROFILE_SCOPE("update");
+			PROFILE_GPU("update");
+
+			// still nothing simulated, the scene belongs to the other thread
+			if(packet) {
+				updateFrameUniforms(packet->camera, dt);
+				render(*packet);
+			}
+
+			update(dt);
+		}
+
+		{
+			PROFILE_SCOPE("assets");
+			PROFILE_GPU("assets");
+
+			// finished loads, within the frame upload budget
+			m_assets->pump();
+		}
+
+		{
+			PROFILE_SCOPE("shaders");
+
+			// variants the driver finished compiling
+			m_shaders->poll();
+		}
+
+		if(m_options.headless) {
+			PROFILE_SCOPE("finish");
+
+			if(m_options.dumpFrames.size())
+				dumpFrame(frame);
+
+			// nothing throttles the queue without a swap
+			glFinish();
+		} else {
+			PROFILE_SCOPE("swap");
+			SDL_GL_SwapWindow(m_window);
+		}
+
+		stagingRing().endFrame();
+
+		m_lastStats = frameStats();
+		frameStats() = FrameStats();
+
+		{
+			PROFILE_SCOPE("limit");
+			m_clock.limit(m_frameLimit);
+		}
+
+		profiler().endFrame();
+
+		// the first tick only measures the start of the loop
+		if(frame && m_options.statsPath.size())
+			m_frameTimes.push_back(dt * 1000.0);
+
+		if(++frame == m_options.frames)
+			close();
+	}
+
+	if(m_simulation.joinable())
+		m_simulation.join();
+
+	if(m_options.statsPath.size())
+		writeStats();
+}
+
+void OpenGLWindow::simulateFrame(FramePacket &packet, double dt)
+{
+	PROFILE_SCOPE("simulate");
+
+	packet.clear();
+	packet.frame = m_simulatedFrames++;
+	packet.dt = dt;
+
+	if(m_options.script)
+		m_options.script(*this, packet.frame);
+
+	if(m_fixedStep > 0.0f) {
+		// after a stall drop time rather than simulate it all
+		m_accumulator = std::min(m_accumulator + dt,
+		double(m_fixedStep) * MAX_FIXED_STEPS);
+
+		while(m_accumulator >= m_fixedStep) {
+			fixedUpdate(m_fixedStep);
+			m_accumulator -= m_fixedStep;
+		}
+
+		m_interpolation = m_accumulator / m_fixedStep;
+	}
+
+	packet.interpolation = m_interpolation;
+
+	simulate(packet, dt);
+
+	packet.camera = m_scene->camera;
+}
+
+void OpenGLWindow::simulationLoop()
+{
+	int target = 0;
+
+	m_simulationClock.reset();
+
+	while(m_running) {
+		simulateFrame(m_packets[target], m_simulationClock.tick());
+
+		unique_lock<mutex> lock(m_packetMutex);
+
+		// a packet the GL thread never picked up is simply replaced
+		m_ready = target;
+		m_packetChanged.notify_all();
+
+		// the other packet is free once the GL thread moved on to this one
+		target ^= 1;
+		m_packetChanged.wait(lock, [&]() {
+			return m_reading != target || !m_running;
+		});
+	}
+}
+
+const FramePacket *OpenGLWindow::acquirePacket()
+{
+	unique_lock<mutex> lock(m_packetMutex);
+
+	// wait for the next packet, but keep handling events when the
+	// simulation stalls
+	m_packetChanged.wait_for(lock, chrono::milliseconds(100), [this]() {
+		return m_ready >= 0 || !m_running;
+	});
+
+	if(m_ready >= 0) {
+		m_reading = m_ready;
+		m_ready = -1;
+		m_packetChanged.notify_all();
+	}
+
+	return m_reading >= 0 ? &m_packets[m_reading] : nullptr;
+}
+
+void FramePacket::clear()
+{
+	items.clear();
+	instances.clear();
+}
+
+void FramePacket::add(Mesh *mesh, Shader *shader, const mat4 *instances,
+size_t count, bool cull)
+{
+	items.push_back({mesh, shader, this->instances.size(), count, cull});
+	this->instances.insert(this->instances.end(), instances, instances + count);
+}
+
+void OpenGLWindow::dumpFrame(uint64_t frame)
+{
+	m_pixels.resize(size_t(width) * height * 4);
+	m_framebuffer.readPixels(m_pixels.data());
+
+	char name[32];
+	snprintf(name, sizeof(name), "/frame_%05llu.png", (unsigned long long)frame);
 
-		m_elapsed = time;
+	string path = m_options.dumpFrames + name;
 
-		update(m_lag * 0.001f);
+	if(!writePng(path, m_pixels.data(), width, height))
+		cerr << "Unable to write " << path << endl;
+}
 
-		SDL_GL_SwapWindow(m_window);
+void OpenGLWindow::writeStats()
+{
+	ofstream file(m_options.statsPath);
+
+	if(!file) {
+		cerr << "Unable to write " << m_options.statsPath << endl;
+		return;
 	}
+
+	vector<float> sorted = m_frameTimes;
+	sort(sorted.begin(), sorted.end());
+
+	double total = 0.0;
+
+	for(float time : sorted)
+		total += time;
+
+	size_t count = sorted.size();
+
+	auto percentile = [&](double p) {
+		return count ? sorted[min(count - 1, size_t(p * count))] : 0.0f;
+	};
+
+	double mean = count ? total / count : 0.0;
+
+	file << "{\n";
+	file << "\t\"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n";
+	file << "\t\"width\": " << width << ",\n";
+	file << "\t\"height\": " << height << ",\n";
+	file << "\t\"frames\": " << count << ",\n";
+	file << "\t\"totalMs\": " << total << ",\n";
+	file << "\t\"meanMs\": " << mean << ",\n";
+	file << "\t\"minMs\": " << (count ? sorted.front() : 0.0f) << ",\n";
+	file << "\t\"maxMs\": " << (count ? sorted.back() : 0.0f) << ",\n";
+	file << "\t\"p50Ms\": " << percentile(0.5) << ",\n";
+	file << "\t\"p95Ms\": " << percentile(0.95) << ",\n";
+	file << "\t\"p99Ms\": " << percentile(0.99) << ",\n";
+	file << "\t\"fps\": " << (mean > 0.0 ? 1000.0 / mean : 0.0) << "\n";
+	file << "}\n";
 }
 
 void OpenGLWindow::sizeChanged(int w, int h)
@@ -514,18 +1381,118 @@ void OpenGLWindow::sizeChanged(int w, int h)
 
 void OpenGLWindow::close()
 {
-	m_running = false;
+	{
+		lock_guard<mutex> lock(m_packetMutex);
+		m_running = false;
+	}
+
+	// the threads may be waiting on each other
+	m_packetChanged.notify_all();
+
 	m_open = false;
 }
 
 float OpenGLWindow::fps()
 {
-	return 1.0f/(m_lag * 0.001f);
+	return m_clock.timing().fps;
+}
+
+const FrameTiming &OpenGLWindow::frameTiming()
+{
+	return m_clock.timing();
+}
+
+bool OpenGLWindow::setSwapInterval(SwapInterval interval)
+{
+	// frames are never presented
+	if(m_options.headless)
+		return false;
+
+	if(!SDL_GL_SetSwapInterval(interval)) {
+		m_swapInterval = interval;
+		return true;
+	}
+
+	// late swap tearing isn't everywhere
+	if(interval == SWAP_ADAPTIVE && !SDL_GL_SetSwapInterval(SWAP_VSYNC))
+		m_swapInterval = SWAP_VSYNC;
+
+	return false;
 }
 
-uint32_t OpenGLWindow::lag()
+SwapInterval OpenGLWindow::swapInterval()
 {
-	return m_lag;
+	return m_swapInterval;
+}
+
+void OpenGLWindow::setFrameLimit(float fps)
+{
+	m_frameLimit = fps;
+}
+
+void OpenGLWindow::setFixedTimestep(float step)
+{
+	m_fixedStep = step;
+	m_accumulator = 0.0;
+	m_interpolation = 0.0f;
+}
+
+float OpenGLWindow::interpolation()
+{
+	return m_interpolation;
+}
+
+void OpenGLWindow::setLazyRedraw(bool lazy)
+{
+	m_lazy = lazy;
+}
+
+void OpenGLWindow::requestRedraw(int frames)
+{
+	for(int current = m_redrawFrames; current < frames &&
+	!m_redrawFrames.compare_exchange_weak(current, frames);)
+		;
+
+	// wake a lazy loop sleeping in waitForRedraw(), the GL thread
+	// itself is not sleeping
+	if(m_lazy && this_thread::get_id() != m_mainThread &&
+	m_wakeEvent != (uint32_t)-1 && !m_wakePending.exchange(true)) {
+		SDL_Event event = {};
+		event.type = m_wakeEvent;
+		SDL_PushEvent(&event);
+	}
+}
+
+void OpenGLWindow::setAnimating(bool animating)
+{
+	m_animating = animating;
+}
+
+bool OpenGLWindow::waitForRedraw()
+{
+	// background work finishes in pump() and poll()
+	if(m_redrawFrames > 0 || m_animating || m_assets->pending() ||
+	m_shaders->pending())
+		return true;
+
+	// leaves the event in the queue for processEvents()
+	if(!SDL_WaitEventTimeout(nullptr, IDLE_TIMEOUT))
+		return false;
+
+	// the idle time is no frame's duration
+	m_clock.resume();
+
+	return true;
+}
+
+const FrameStats &OpenGLWindow::lastFrameStats()
+{
+	return m_lastStats;
+}
+
+const FrameUniforms &OpenGLWindow::frameUniforms()
+{
+	return m_frameUniforms;
 }
 
 bool OpenGLWindow::isRunning()
@@ -538,6 +1505,26 @@ bool OpenGLWindow::aboutToBeClosed()
 	return !m_open;
 }
 
+ShaderLibrary *OpenGLWindow::shaders()
+{
+	return m_shaders;
+}
+
+TextureAtlas *OpenGLWindow::atlas()
+{
+	return m_atlas;
+}
+
+JobSystem *OpenGLWindow::jobs()
+{
+	return m_jobs;
+}
+
+AssetLoader *OpenGLWindow::assets()
+{
+	return m_assets;
+}
+
 OpenGLScene *OpenGLWindow::scene()
 {
 	return m_scene;
@@ -553,6 +1540,40 @@ SDL_GLContext OpenGLWindow::context()
 	return m_context;
 }
 
+bool OpenGLWindow::headless()
+{
+	return m_options.headless;
+}
+
+void OpenGLWindow::fixedUpdate(float step)
+{
+
+}
+
+void OpenGLWindow::simulate(FramePacket &packet, float dt)
+{
+
+}
+
+void OpenGLWindow::render(const FramePacket &packet)
+{
+	const Frustum &frustum = packet.camera.frustum();
+
+	for(const DrawItem &item : packet.items) {
+		if(item.shader)
+			glState().useProgram(item.shader->program());
+
+		const mat4 *instances = packet.instances.data() + item.firstInstance;
+
+		if(item.cull)
+			item.mesh->updateInstancesVBO(instances, item.instanceCount, frustum);
+		else
+			item.mesh->updateInstancesVBO(instances, item.instanceCount);
+
+		item.mesh->draw();
+	}
+}
+
 void OpenGLWindow::update(float dt)
 {
 
@@ -563,23 +1584,87 @@ void OpenGLWindow::processEvent(const SDL_Event &event)
 
 }
 
+void OpenGLWindow::updateFrameUniforms(const Camera &camera, float dt)
+{
+	FrameUniforms &frame = m_frameUniforms;
+
+	frame.view = camera.view();
+	frame.projection = camera.projection();
+	frame.viewProjection = camera.viewProjection();
+	frame.cameraPosition = camera.inverseView()[3];
+	frame.time += dt;
+	frame.deltaTime = dt;
+
+	// bound once, programs find it through their "Frame" block binding
+	if(!m_frameUBO) {
+		glGenBuffers(1, &m_frameUBO);
+		glState().bindBuffer(GL_UNIFORM_BUFFER, m_frameUBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr,
+		GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, m_frameUBO);
+	}
+
+	glState().bindBuffer(GL_UNIFORM_BUFFER, m_frameUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+	glState().bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 void OpenGLWindow::processEvents()
 {
-	SDL_Event event;
+	SDL_Event event, motion;
+	bool moved = false;
 
+	// consecutive mouse motion is merged into one event, with the last
+	// position and the summed relative motion
 	while(SDL_PollEvent(&event)) {
-		processEvent(event);
+		if(event.type == SDL_MOUSEMOTION) {
+			if(moved && motion.motion.which == event.motion.which &&
+			motion.motion.windowID == event.motion.windowID) {
+				event.motion.xrel += motion.motion.xrel;
+				event.motion.yrel += motion.motion.yrel;
+			} else if(moved) {
+				dispatchEvent(motion);
+			}
 
-		if(event.type == SDL_QUIT)
-			close();
+			motion = event;
+			moved = true;
+			continue;
+		}
 
-		if(event.type == SDL_WINDOWEVENT) {
-			if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-				width = event.window.data1;
-                height = event.window.data2;
+		if(moved) {
+			dispatchEvent(motion);
+			moved = false;
+		}
 
-                sizeChanged(width, height);
-			}
+		dispatchEvent(event);
+	}
+
+	if(moved)
+		dispatchEvent(motion);
+}
+
+void OpenGLWindow::dispatchEvent(const SDL_Event &event)
+{
+	if(event.type == m_wakeEvent) {
+		m_wakePending = false;
+		return;
+	}
+
+	// whatever happened may change what is shown
+	if(m_redrawFrames < 1)
+		m_redrawFrames = 1;
+
+	processEvent(event);
+
+	if(event.type == SDL_QUIT)
+		close();
+
+	if(event.type == SDL_WINDOWEVENT) {
+		if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+			width = event.window.data1;
+            height = event.window.data2;
+
+            sizeChanged(width, height);
 		}
 	}
 }
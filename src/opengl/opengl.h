@@ -10,6 +10,10 @@
 #include <queue>
 #include <unordered_map>
 #include <thread>
+#include <functional>
+#include <condition_variable>
+#include <atomic>
+#include <mutex>
 
 #include <GL/glew.h>
 #include <GL/glu.h>
@@ -20,15 +24,79 @@
 #include "camera.h"
 #include "volumes.h"
 #include "sparse_vector.h"
+#include "dirty_ranges.h"
+#include "staging.h"
+#include "culling.h"
+#include "texture_cache.h"
+#include "state_cache.h"
+#include "frame_clock.h"
+#include "profiler.h"
+#include "framebuffer.h"
+#include "jobs.h"
+#include "hash.h"
+
+#ifdef ENABLE_HEADLESS
+#include "headless.h"
+#endif
 
 namespace gl {
+	// counters of the frame being built, reset every frame by OpenGLWindow
+	struct FrameStats {
+		size_t bytesUploaded = 0;
+		size_t uploads = 0;
+		size_t instancesVisible = 0;
+		size_t instancesCulled = 0;
+		size_t textureBinds = 0;
+		size_t stateCalls = 0; // binds and enables sent to the driver
+		size_t stateElided = 0; // and dropped by glState() as redundant
+	};
+
+	FrameStats &frameStats();
+
+	// compile time key of a uniform name, see Shader::uniform()
+	typedef uint64_t UniformKey;
+
+	constexpr UniformKey uniformKey(const char *name)
+	{
+		return fnv1a(name);
+	}
+
+	// binding point of the "Frame" uniform block
+#define FRAME_UNIFORM_BINDING 0
+
+	// per frame values shared by every program through the std140 block
+	// "Frame", uploaded once per frame by OpenGLWindow
+	struct FrameUniforms {
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		glm::vec4 cameraPosition; // w unused
+		float time = 0.0f; // seconds since run()
+		float deltaTime = 0.0f;
+		float pad[2];
+	};
+
 	class Shader {
 		public:
 			Shader();
+			// linked from source, or loaded from the program binary cache
+			// written by an earlier run on the same driver
 			Shader(const char *vertexPath, const char *fragmentPath);
+			// adopt a linked program
+			explicit Shader(unsigned int program);
 
 			unsigned int program();
 
+			// location of an active uniform, -1 if the program has none
+			// by that name. Arrays are found by their bare name.
+			int uniform(UniformKey key) const;
+
+			void setMat4(int location, const glm::mat4 &value);
+			void setMat3(int location, const glm::mat3 &value);
+			void setInt(int location, const int &value);
+			void setFloat(int location, const float &value);
+
+			// by name, hashed on every call, prefer uniform() once
 			void setMat4(const std::string &name, const glm::mat4 &value);
 			void setMat3(const std::string &name, const glm::mat3 &value);
 			void setInt(const std::string &name, const int &value);
@@ -39,26 +107,58 @@ namespace gl {
 			unsigned int m_fragment;
 			unsigned int m_program;
 
-			std::map<std::string, int> m_uniforms;
+			// active uniforms reflected at link, sorted by key
+			std::vector<std::pair<UniformKey, int>> m_uniforms;
 
-			bool addFromFile(int type, const char *path);
 			bool addFromSource(int type, const char *src);
 			bool link();
 
-			int uniformLocation(const std::string &name);
+			void reflect();
 	};
 
+	struct ModelData;
+	class AssetLoader;
+	class ShaderLibrary;
+	class TextureAtlas;
+
+	// index + 1 of an atlas image, 0 is never a valid handle
+	typedef uint32_t AtlasHandle;
+
 	struct Texture {
 			unsigned int id;
-			std::string type;
-			std::string path;
+			TextureHandle handle; // 0 when not owned by the texture cache
+			const char *type; // interned
+			const char *path; // interned
+
+			Texture(unsigned int id, const char* type, const char* path,
+			TextureHandle handle = 0);
 
-			Texture(unsigned int id, const char* type, const char* path);
+			// current GL name, a placeholder until an async load completes
+			unsigned int glId() const;
 
+			// loads go through textureCache(), every call holds a reference
+			// that Mesh::cleanup() releases
 			static Texture loadFromPath(const char* path, const char* type);
 			static Texture loadFromImage(unsigned char* image, int w, int h, int ch, const char* type);
 	};
 
+	// material of an imported mesh, its diffuse texture path (empty for
+	// none) and the contiguous range of indices drawn with it
+	struct MaterialRef {
+			int materialId;
+			std::string diffuseTexture;
+			size_t firstIndex;
+			size_t indexCount;
+	};
+
+	// index range of a mesh drawn with one texture, -1 for none
+	struct SubMesh {
+			size_t firstIndex;
+			size_t indexCount;
+			int materialId;
+			int texture;
+	};
+
 	struct Vertex {
 			glm::vec3 pos;
 			glm::vec3 normal;
@@ -75,42 +175,138 @@ namespace gl {
 			Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
 			std::vector<Texture> textures);
 
+			// upload straight from memory owned by the caller, e.g. a mapped
+			// file, without keeping CPU copies of vertices and indices. Fill
+			// both before using the dirty range updates below
+			Mesh(const Vertex *vertices, size_t vertexCount,
+			const unsigned int *indices, size_t indexCount,
+			std::vector<Texture> textures, const Volume &volume,
+			const Sphere &sphere);
+
+			// allocate buffers only, to be filled in slices with
+			// uploadVertices() and uploadIndices()
+			Mesh(size_t vertexCount, size_t indexCount,
+			std::vector<Texture> textures, const Volume &volume,
+			const Sphere &sphere);
+
 			~Mesh();
 
             void cleanup();
 
+			// record modified elements, nearby ranges are merged
+			void markVerticesDirty(size_t first, size_t count);
+			void markIndicesDirty(size_t first, size_t count);
+
+			// upload the dirty ranges through the staging ring, or the
+			// whole array if nothing was marked since the last upload.
+			// Needs the CPU copy, meshes of files have none unless loaded
+			// with keepCpuData
 			void updateVBO();
-            void updateInstancesVBO(glm::mat4 *instances, size_t count);
+			void updateEBO();
+			// upload instance matrices and their normal matrices
+            void updateInstancesVBO(const glm::mat4 *instances, size_t count);
+
+			// upload only the instances whose transformed volume intersects
+			// frustum, with their normal matrices, returns the number of
+			// instances to draw
+			size_t updateInstancesVBO(const glm::mat4 *instances, size_t count,
+			const Frustum &frustum);
+
+			size_t instanceCount() const;
+
+			// draw instanceCount() instances, one call and texture bind per
+			// submesh, or the whole mesh with its first texture if it has
+			// none. The vertex array stays bound.
+			void draw();
+
+			// number of indices in the element buffer
+			size_t indexCount() const;
+
+			// fill vertices and indices with a copy of what the buffers
+			// were created from, for updates after a raw pointer upload
+			void keepCpuData(const Vertex *vertexData, size_t vertexCount,
+			const unsigned int *indexData, size_t indexCount);
+
+			// write straight into the buffers through the staging ring
+			void uploadVertices(const Vertex *data, size_t first, size_t count);
+			void uploadIndices(const unsigned int *data, size_t first,
+			size_t count);
 
             unsigned int VAO = 0, VBO, EBO, intancesVBO;
+			unsigned int normalsVBO; // per instance NormalMatrix
 
 			std::vector<Vertex> vertices;
 			std::vector<unsigned int> indices;
 			std::vector<Texture> textures;
+			std::vector<SubMesh> submeshes;
             Volume volume;
+			Sphere sphere;
 
 		private:
             size_t instancesDrawn = 0;
+			size_t instancesCapacity = 0;
+			size_t normalsCapacity = 0;
+			size_t vertexCapacity = 0;
+			size_t indexCapacity = 0;
+			size_t elements = 0;
+
+			DirtyRanges dirtyVertices;
+			DirtyRanges dirtyIndices;
+
+			InstanceCuller culler;
 
 			void setup();
+			void setupBuffers(const Vertex *vertexData, size_t vertexCount,
+			const unsigned int *indexData, size_t indexCount, GLenum usage);
 	};
 
 	class Model {
 		public:
 			Model();
 			Model(const std::vector<Mesh> &meshes);
-			Model(const std::string &path);
+			// weldEpsilon > 0 also merges vertices closer than it, for
+			// noisy scanned data. keepCpuData fills the vertices and
+			// indices of every mesh, for meshes edited after loading.
+			// Textures small enough for atlas go onto its pages
+			Model(const std::string &path, float weldEpsilon = 0.0f,
+			bool keepCpuData = false, TextureAtlas *atlas = nullptr);
 
 			~Model();
 
 			std::vector<Mesh> meshes;
 
+			// CPU side of a load: the cooked cache, or parsing, welding and
+			// cooking the source. Touches no GL state and can run on any
+			// thread, returns false if the model can not be read
+			static bool read(const std::string &path, float weldEpsilon,
+			ModelData &data);
+
+			// create meshes and textures from the result of read()
+			void create(const ModelData &data);
+
+			// one texture and submesh per material, textures load through
+			// loader when given. Materials with an image in atlasHandles,
+			// from TextureAtlas::pack(), use its page instead
+			static void createMaterials(const std::vector<MaterialRef> &materials,
+			std::vector<Texture> &textures, std::vector<SubMesh> &submeshes,
+			AssetLoader *loader = nullptr, const TextureAtlas *atlas = nullptr,
+			const std::vector<AtlasHandle> *atlasHandles = nullptr);
+
 		private:
 			std::string m_path;
+			float m_weldEpsilon = 0.0f;
+			bool m_keepCpuData = false;
+			TextureAtlas *m_atlas = nullptr;
 
-			std::string pathFromFileName(const std::string &fileName);
+			static std::string pathFromFileName(const std::string &fileName);
+			static uint64_t hashMaterialFiles(const std::string &path,
+			uint64_t hash);
 
 			void load(const std::string &path);
+			static bool readObj(const std::string &path, float weldEpsilon,
+			ModelData &data);
+			static bool readCooked(const std::string &path, uint64_t sourceHash,
+			uint64_t sourceSize, ModelData &data);
 	};
 
 	class OpenGLScene {
@@ -122,24 +318,142 @@ namespace gl {
 			// TODO lights
 	};
 
+	// values for OpenGLWindow::setSwapInterval()
+	enum SwapInterval {
+		SWAP_IMMEDIATE = 0,
+		SWAP_VSYNC = 1,
+		SWAP_ADAPTIVE = -1 // vsync, late frames swap at once and tear
+	};
+
+	// one mesh of a FramePacket, instanceCount matrices from firstInstance
+	// in FramePacket::instances
+	struct DrawItem {
+		Mesh *mesh;
+		Shader *shader; // made current before drawing when set
+		size_t firstInstance;
+		size_t instanceCount;
+		bool cull; // against the packet camera, on the GL thread
+	};
+
+	// What the GL thread draws of one simulated frame. With a simulation
+	// thread the packet is immutable once handed over, and the GL thread
+	// draws it while the next one is being simulated. Meshes and shaders
+	// referenced by a packet belong to the GL thread and must outlive it.
+	struct FramePacket {
+		uint64_t frame = 0;
+		float dt = 0.0f; // simulated seconds
+		float interpolation = 0.0f; // see OpenGLWindow::interpolation()
+		Camera camera; // copy of the scene camera after simulation
+		std::vector<DrawItem> items;
+		std::vector<glm::mat4> instances;
+
+		void clear();
+		void add(Mesh *mesh, Shader *shader, const glm::mat4 *instances,
+		size_t count, bool cull = true);
+	};
+
+	class OpenGLWindow;
+
+	struct WindowOptions {
+		int width = 800;
+		int height = 600;
+
+		// no window, an EGL context renders into an offscreen framebuffer.
+		// Needs a build with ENABLE_HEADLESS
+		bool headless = false;
+
+		// stop after this many frames, 0 runs until closed
+		uint64_t frames = 0;
+
+		// called with the simulated frame number before every
+		// simulate(), for scripted scenes
+		std::function<void(OpenGLWindow &window, uint64_t frame)> script;
+
+		// directory to write every headless frame to as
+		// frame_<number>.png
+		std::string dumpFrames;
+
+		// file to write frame time statistics to as JSON when run() ends
+		std::string statsPath;
+
+		// run fixedUpdate() and simulate() on a thread of their own, one
+		// frame ahead of the GL thread
+		bool simulationThread = false;
+
+		// draw only when needed, see OpenGLWindow::setLazyRedraw()
+		bool lazyRedraw = false;
+	};
+
 	class OpenGLWindow {
 		public:
-			OpenGLWindow();
+			OpenGLWindow(const WindowOptions &options = WindowOptions());
 			~OpenGLWindow();
 
 			void setTitle(const char *title);
             void run();
 			void close();
 			float fps();
-			uint32_t lag();
+			const FrameTiming &frameTiming();
+			const FrameStats &lastFrameStats();
+			const FrameUniforms &frameUniforms();
 			bool isRunning();
 			bool aboutToBeClosed();
 
 			OpenGLScene *scene();
+			AssetLoader *assets();
+			ShaderLibrary *shaders();
+
+			// pages shared by small model textures, assets() packs onto it
+			TextureAtlas *atlas();
+
+			// engine thread pool, also behind ::parallelFor()
+			JobSystem *jobs();
 			SDL_Window *sdlWindow();
 			SDL_GLContext context();
+			bool headless();
+
+			// false when the driver refuses, adaptive falls back to vsync
+			bool setSwapInterval(SwapInterval interval);
+			SwapInterval swapInterval();
+
+			// highest frame rate, 0 for no limit
+			void setFrameLimit(float fps);
+
+			// seconds per fixedUpdate(), 0 to only call update()
+			void setFixedTimestep(float step);
+
+			// Sleep in SDL_WaitEventTimeout() and draw a frame only after
+			// an event, while animating, while loads or shader compiles
+			// are pending, or when requested. For tools that idle most of
+			// the time, ignored when headless
+			void setLazyRedraw(bool lazy);
+
+			// draw at least frames more frames in lazy mode, any thread
+			void requestRedraw(int frames = 1);
+
+			// keep drawing every frame in lazy mode while set
+			void setAnimating(bool animating);
+
+			// fraction of a fixed step the frame is past the last
+			// fixedUpdate(), for interpolating between simulation states.
+			// With a simulation thread read FramePacket::interpolation
+			float interpolation();
 
 		protected:
+			// zero or more times a frame, before simulate(). On the
+			// simulation thread when there is one
+			virtual void fixedUpdate(float step);
+
+			// fill packet with what to draw, after fixedUpdate(). On the
+			// simulation thread when there is one, where it owns the scene
+			// and must not touch GL or SDL
+			virtual void simulate(FramePacket &packet, float dt);
+
+			// draw packet, GL thread, before update(). The default draws
+			// every item, culling those that ask for it
+			virtual void render(const FramePacket &packet);
+
+			// GL thread, after render()
 			virtual void update(float dt);
 			virtual void processEvent(const SDL_Event &event);
             virtual	void sizeChanged(int w, int h);
@@ -148,15 +462,72 @@ namespace gl {
 
 		private:
 			void processEvents();
+			void dispatchEvent(const SDL_Event &event);
 
-			OpenGLScene *m_scene;
-			SDL_Window *m_window;
-			SDL_GLContext m_context;
+			// lazy mode, block until a frame is wanted, false on timeout
+			bool waitForRedraw();
+
+			// write the framebuffer to WindowOptions::dumpFrames
+			void dumpFrame(uint64_t frame);
+			void writeStats();
+
+			// upload camera to the frame uniform buffer
+			void updateFrameUniforms(const Camera &camera, float dt);
 
-			uint32_t m_elapsed;
-			uint32_t m_lag;
+			// fixed steps, simulate() and the camera into packet
+			void simulateFrame(FramePacket &packet, double dt);
 
-			bool m_running;
+			// simulation thread and the GL side of the packet handoff
+			void simulationLoop();
+			const FramePacket *acquirePacket();
+
+			OpenGLScene *m_scene;
+			JobSystem *m_jobs;
+			AssetLoader *m_assets;
+			ShaderLibrary *m_shaders;
+			TextureAtlas *m_atlas;
+
+			unsigned int m_frameUBO = 0;
+			FrameUniforms m_frameUniforms;
+			SDL_Window *m_window = nullptr;
+			SDL_GLContext m_context = nullptr;
+
+			WindowOptions m_options;
+#ifdef ENABLE_HEADLESS
+			HeadlessContext m_headless;
+#endif
+			Framebuffer m_framebuffer;
+			std::vector<unsigned char> m_pixels; // frame dump
+			std::vector<float> m_frameTimes; // ms, for the statistics
+
+			FrameClock m_clock;
+			SwapInterval m_swapInterval = SWAP_VSYNC;
+			float m_frameLimit = 0.0f;
+			float m_fixedStep = 0.0f;
+			double m_accumulator = 0.0;
+			float m_interpolation = 0.0f;
+
+			FrameStats m_lastStats;
+
+			// m_packets[m_reading] is drawn by the GL thread,
+			// m_packets[m_ready] is the newest finished one, -1 for none
+			FramePacket m_packets[2];
+			int m_reading = -1;
+			int m_ready = -1;
+			uint64_t m_simulatedFrames = 0;
+			FrameClock m_simulationClock;
+			std::thread m_simulation;
+			std::mutex m_packetMutex;
+			std::condition_variable m_packetChanged;
+
+			bool m_lazy;
+			bool m_animating = false;
+			std::atomic<int> m_redrawFrames;
+			std::atomic<bool> m_wakePending;
+			uint32_t m_wakeEvent; // pushed to end the wait of lazy mode
+			std::thread::id m_mainThread;
+
+			std::atomic<bool> m_running;
 			bool m_open;
 	};
 
@@ -0,0 +1,61 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "jobs.h"
+
+// set while a thread runs a chunk of the thread per call fallback
+inline thread_local bool parallelForNested = false;
+
+// Split [begin, end) into chunks of at least minChunk and call
+// fn(chunkBegin, chunkEnd) on each. Runs on gl::JobSystem::current() when
+// there is one, where nesting is free. Without it every call starts one
+// thread per hardware thread, and calls made from inside a chunk run
+// inline so nested loops don't multiply the thread count.
+template <typename F>
+void parallelFor(size_t begin, size_t end, size_t minChunk, const F &fn)
+{
+    if(gl::JobSystem *jobs = gl::JobSystem::current()) {
+        jobs->parallelFor(begin, end, minChunk, fn);
+        return;
+    }
+
+    size_t count = end > begin ? end - begin : 0;
+    size_t threads = parallelForNested ? 1 :
+        std::max(1u, std::thread::hardware_concurrency());
+
+    threads = std::min(threads, count / std::max<size_t>(minChunk, 1));
+
+    if(threads <= 1) {
+        if(count)
+            fn(begin, end);
+        return;
+    }
+
+    size_t chunk = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+
+    // the calling thread takes the first chunk
+    for(size_t t = 1; t < threads; ++t) {
+        size_t b = begin + t * chunk;
+        size_t e = std::min(end, b + chunk);
+
+        if(b < e)
+            workers.emplace_back([&fn, b, e]() {
+                parallelForNested = true;
+                fn(b, e);
+            });
+    }
+
+    parallelForNested = true;
+    fn(begin, std::min(end, begin + chunk));
+    parallelForNested = false;
+
+    for(std::thread &worker : workers)
+        worker.join();
+}
+
+#endif
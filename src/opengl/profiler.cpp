@@ -0,0 +1,320 @@
+#include "profiler.h"
+
+#include <cstring>
+#include <fstream>
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+
+using namespace gl;
+using namespace std;
+
+// frames kept for writeTrace()
+#define PROFILE_TRACE_FRAMES 300
+
+// weight of the newest frame in ProfileScopeStats::average
+#define PROFILE_SMOOTHING 0.05f
+
+static thread_local void *threadBufferOf = nullptr;
+
+Profiler::Profiler()
+{
+	m_epoch = SDL_GetPerformanceCounter();
+	m_frameStart = m_epoch;
+	m_microsecondsPerCount = 1e6 / SDL_GetPerformanceFrequency();
+}
+
+Profiler::~Profiler()
+{
+	// queries die with the context, release() deletes them before that
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+	m_enabled = enabled;
+}
+
+bool Profiler::enabled() const
+{
+	return m_enabled;
+}
+
+Profiler::ThreadBuffer &Profiler::threadBuffer()
+{
+	if(!threadBufferOf) {
+		lock_guard<mutex> lock(m_threadsMutex);
+
+		m_threads.emplace_back(new ThreadBuffer);
+		m_threads.back()->id = m_threads.size() - 1;
+		threadBufferOf = m_threads.back().get();
+	}
+
+	return *static_cast<ThreadBuffer*>(threadBufferOf);
+}
+
+uint64_t Profiler::enter()
+{
+	if(!m_enabled)
+		return 0;
+
+	threadBuffer().depth++;
+
+	return SDL_GetPerformanceCounter();
+}
+
+void Profiler::leave(const char *name, uint64_t start)
+{
+	uint64_t end = SDL_GetPerformanceCounter();
+	ThreadBuffer &buffer = threadBuffer();
+
+	buffer.depth--;
+
+	// only contended while endFrame() takes the events
+	lock_guard<mutex> lock(buffer.mutex);
+	buffer.events.push_back({name, start, end, buffer.depth});
+}
+
+bool Profiler::beginGpu(const char *name)
+{
+	// one GL_TIME_ELAPSED query can be active at a time
+	if(!m_enabled || m_gpuActive)
+		return false;
+
+	unsigned int query;
+
+	if(m_freeQueries.size()) {
+		query = m_freeQueries.back();
+		m_freeQueries.pop_back();
+	} else {
+		glGenQueries(1, &query);
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, query);
+
+	m_gpu[m_gpuSet].push_back({name, SDL_GetPerformanceCounter(), query});
+	m_gpuActive = true;
+
+	return true;
+}
+
+void Profiler::endGpu()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	m_gpuActive = false;
+}
+
+void Profiler::beginFrame()
+{
+	m_frameStart = SDL_GetPerformanceCounter();
+	m_mainThread = threadBuffer().id;
+}
+
+void Profiler::endFrame()
+{
+	m_frames.emplace_back();
+	Frame &frame = m_frames.back();
+
+	frame.start = microseconds(m_frameStart);
+	frame.duration = microseconds(SDL_GetPerformanceCounter()) - frame.start;
+
+	vector<RawEvent> events;
+
+	{
+		lock_guard<mutex> lock(m_threadsMutex);
+
+		for(unique_ptr<ThreadBuffer> &buffer : m_threads) {
+			{
+				lock_guard<mutex> lock(buffer->mutex);
+				events.swap(buffer->events);
+			}
+
+			for(const RawEvent &event : events) {
+				frame.events.push_back({event.name, microseconds(event.start),
+				(event.end - event.start) * m_microsecondsPerCount, buffer->id,
+				event.depth});
+			}
+
+			events.clear();
+		}
+	}
+
+	collectGpu(frame);
+	updateStats(frame);
+
+	while(m_frames.size() > PROFILE_TRACE_FRAMES)
+		m_frames.pop_front();
+}
+
+void Profiler::collectGpu(Frame &frame)
+{
+	// queries of the frame before, the GPU has had a whole frame
+	vector<GpuQuery> &previous = m_gpu[m_gpuSet ^ 1];
+
+	for(const GpuQuery &gpu : previous) {
+		int available;
+		glGetQueryObjectiv(gpu.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+		// still running, drop it rather than wait
+		if(available) {
+			GLuint64 nanoseconds;
+			glGetQueryObjectui64v(gpu.query, GL_QUERY_RESULT, &nanoseconds);
+
+			frame.events.push_back({gpu.name, microseconds(gpu.start),
+			nanoseconds * 0.001, GPU_THREAD, 0});
+		}
+
+		m_freeQueries.push_back(gpu.query);
+	}
+
+	previous.clear();
+	m_gpuSet ^= 1;
+}
+
+void Profiler::updateStats(const Frame &frame)
+{
+	m_head = (m_head + 1) % PROFILE_HISTORY;
+
+	for(ProfileScopeStats &scope : m_scopes)
+		scope.history[m_head] = 0.0f;
+
+	for(const ProfileEvent &event : frame.events) {
+		bool gpu = event.thread == GPU_THREAD;
+		ProfileScopeStats *stats = nullptr;
+
+		// literals of the same name may differ in address across files
+		for(ProfileScopeStats &scope : m_scopes) {
+			if(scope.gpu == gpu && (scope.name == event.name ||
+			!strcmp(scope.name, event.name))) {
+				stats = &scope;
+				break;
+			}
+		}
+
+		if(!stats) {
+			m_scopes.push_back(ProfileScopeStats());
+			stats = &m_scopes.back();
+			stats->name = event.name;
+			stats->gpu = gpu;
+			stats->average = 0.0f;
+			memset(stats->history, 0, sizeof(stats->history));
+		}
+
+		stats->history[m_head] += event.duration * 0.001;
+	}
+
+	for(ProfileScopeStats &scope : m_scopes) {
+		scope.average += (scope.history[m_head] - scope.average) *
+		PROFILE_SMOOTHING;
+	}
+}
+
+const vector<ProfileScopeStats> &Profiler::scopes() const
+{
+	return m_scopes;
+}
+
+size_t Profiler::historyHead() const
+{
+	return m_head;
+}
+
+const vector<ProfileEvent> &Profiler::lastFrame() const
+{
+	static const vector<ProfileEvent> none;
+
+	return m_frames.size() ? m_frames.back().events : none;
+}
+
+double Profiler::lastFrameStart() const
+{
+	return m_frames.size() ? m_frames.back().start : 0.0;
+}
+
+double Profiler::lastFrameDuration() const
+{
+	return m_frames.size() ? m_frames.back().duration : 0.0;
+}
+
+uint32_t Profiler::mainThread() const
+{
+	return m_mainThread;
+}
+
+static void writeString(ofstream &file, const char *text)
+{
+	file << '"';
+
+	for(; *text; text++) {
+		if(*text == '"' || *text == '\\')
+			file << '\\';
+
+		file << *text;
+	}
+
+	file << '"';
+}
+
+bool Profiler::writeTrace(const string &path) const
+{
+	ofstream file(path);
+
+	if(!file)
+		return false;
+
+	file << "{\"traceEvents\":[\n";
+
+	// name the rows, GPU work gets a row of its own
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" <<
+	m_mainThread << ",\"args\":{\"name\":\"main\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" <<
+	GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+
+	file.precision(3);
+	file << fixed;
+
+	for(const Frame &frame : m_frames) {
+		file << ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":" <<
+		m_mainThread << ",\"ts\":" << frame.start << ",\"dur\":" <<
+		frame.duration << "}";
+
+		for(const ProfileEvent &event : frame.events) {
+			file << ",\n{\"name\":";
+			writeString(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread <<
+			",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+		}
+	}
+
+	file << "\n]}\n";
+
+	return bool(file);
+}
+
+void Profiler::release()
+{
+	if(m_gpuActive)
+		endGpu();
+
+	for(vector<GpuQuery> &set : m_gpu) {
+		for(const GpuQuery &gpu : set)
+			m_freeQueries.push_back(gpu.query);
+
+		set.clear();
+	}
+
+	if(m_freeQueries.size())
+		glDeleteQueries(m_freeQueries.size(), m_freeQueries.data());
+
+	m_freeQueries.clear();
+}
+
+double Profiler::microseconds(uint64_t counter) const
+{
+	return (counter - m_epoch) * m_microsecondsPerCount;
+}
+
+Profiler &gl::profiler()
+{
+	static Profiler profiler;
+	return profiler;
+}
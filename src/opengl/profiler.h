@@ -0,0 +1,181 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// frames of per scope history kept for graphs
+#define PROFILE_HISTORY 256
+
+namespace gl {
+	// one timed scope of a finished frame, microseconds since the
+	// profiler started
+	struct ProfileEvent {
+		const char *name;
+		double start;
+		double duration;
+		uint32_t thread; // GPU events use Profiler::GPU_THREAD
+		uint16_t depth;
+	};
+
+	// per frame milliseconds of one scope name, summed over its calls
+	struct ProfileScopeStats {
+		const char *name;
+		bool gpu;
+		float history[PROFILE_HISTORY]; // ring, see Profiler::historyHead()
+		float average; // moving average in ms
+	};
+
+	// Frame profiler. CPU scopes cost two counter reads and an append to
+	// a buffer of their own thread, so they can stay in release builds;
+	// any thread may open them. GPU scopes wrap GL_TIME_ELAPSED queries,
+	// read back a frame later from double-buffered query sets so they
+	// never wait on the GPU, and can't nest. Scope names must be string
+	// literals or otherwise outlive the profiler.
+	class Profiler {
+		public:
+			static const uint32_t GPU_THREAD = 0xffffffffu;
+
+			Profiler();
+			~Profiler();
+
+			Profiler(const Profiler &) = delete;
+			Profiler &operator=(const Profiler &) = delete;
+
+			void setEnabled(bool enabled);
+			bool enabled() const;
+
+			// called by OpenGLWindow around every frame, endFrame() after
+			// the swap
+			void beginFrame();
+			void endFrame();
+
+			// scope statistics, ordered by first appearance
+			const std::vector<ProfileScopeStats> &scopes() const;
+			size_t historyHead() const; // index of the newest entry
+
+			// events of the last finished frame, GPU ones from the frame
+			// before it
+			const std::vector<ProfileEvent> &lastFrame() const;
+			double lastFrameStart() const;
+			double lastFrameDuration() const;
+			uint32_t mainThread() const;
+
+			// write the retained frames as Chrome trace event JSON, for
+			// chrome://tracing or Perfetto
+			bool writeTrace(const std::string &path) const;
+
+			// delete GL queries, the context must be current
+			void release();
+
+			// used by the scope classes below
+			uint64_t enter();
+			void leave(const char *name, uint64_t start);
+			bool beginGpu(const char *name);
+			void endGpu();
+
+		private:
+			struct RawEvent {
+				const char *name;
+				uint64_t start, end; // performance counter
+				uint16_t depth;
+			};
+
+			struct ThreadBuffer {
+				std::mutex mutex;
+				std::vector<RawEvent> events;
+				uint32_t id;
+				uint16_t depth = 0;
+			};
+
+			struct GpuQuery {
+				const char *name;
+				uint64_t start; // CPU counter when issued
+				unsigned int query;
+			};
+
+			struct Frame {
+				double start, duration;
+				std::vector<ProfileEvent> events;
+			};
+
+			bool m_enabled = true;
+
+			std::mutex m_threadsMutex;
+			std::vector<std::unique_ptr<ThreadBuffer>> m_threads;
+
+			ThreadBuffer &threadBuffer();
+
+			// query sets of the current and of the previous frame
+			std::vector<GpuQuery> m_gpu[2];
+			std::vector<unsigned int> m_freeQueries;
+			unsigned int m_gpuSet = 0;
+			bool m_gpuActive = false;
+
+			uint64_t m_epoch;
+			uint64_t m_frameStart;
+			double m_microsecondsPerCount;
+			uint32_t m_mainThread = 0;
+
+			std::vector<ProfileScopeStats> m_scopes;
+			size_t m_head = 0;
+
+			// recent frames for traces, the last one is lastFrame()
+			std::deque<Frame> m_frames;
+
+			double microseconds(uint64_t counter) const;
+			void collectGpu(Frame &frame);
+			void updateStats(const Frame &frame);
+	};
+
+	Profiler &profiler();
+
+	// times the enclosing block on the CPU
+	class ProfileScope {
+		public:
+			ProfileScope(const char *name) : m_name(name),
+			m_start(profiler().enter()) {}
+
+			~ProfileScope()
+			{
+				if(m_start)
+					profiler().leave(m_name, m_start);
+			}
+
+		private:
+			const char *m_name;
+			uint64_t m_start; // 0 while disabled
+	};
+
+	// times the GL commands of the enclosing block on the GPU
+	class GpuScope {
+		public:
+			GpuScope(const char *name) : m_active(profiler().beginGpu(name)) {}
+
+			~GpuScope()
+			{
+				if(m_active)
+					profiler().endGpu();
+			}
+
+		private:
+			bool m_active;
+	};
+
+} // namespace gl
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+
+#define PROFILE_SCOPE(name) \
+	gl::ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#define PROFILE_GPU(name) \
+	gl::GpuScope PROFILE_CONCAT(gpuScope, __LINE__)(name)
+
+#endif
@@ -0,0 +1,143 @@
+#include "program_cache.h"
+#include "hash.h"
+#include "state_cache.h"
+
+#include <GL/glew.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace gl;
+using namespace std;
+
+#define PROGRAM_MAGIC "GLPROG\0"
+#define PROGRAM_VERSION 1
+
+namespace {
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t format; // driver binary format
+		uint64_t key;
+		uint64_t size;
+	};
+
+	const char *glString(GLenum name)
+	{
+		const char *str = (const char*)glGetString(name);
+		return str ? str : "";
+	}
+}
+
+uint64_t gl::programKey(const vector<string> &sources)
+{
+	uint64_t key = fnv1a(glString(GL_VENDOR));
+	key = fnv1a(glString(GL_RENDERER), key);
+	key = fnv1a(glString(GL_VERSION), key);
+
+	for(const string &source : sources)
+		key = hashBytes(source.data(), source.size(), key);
+
+	return key;
+}
+
+string gl::programCachePath(const string &vertexPath,
+const string &fragmentPath, uint64_t variant)
+{
+	size_t slash = fragmentPath.find_last_of("/\\");
+	string fragmentName = slash == string::npos ? fragmentPath :
+	fragmentPath.substr(slash + 1);
+
+	string path = vertexPath + "." + fragmentName;
+
+	if(variant) {
+		char suffix[20];
+		snprintf(suffix, sizeof(suffix), ".%016llx", (unsigned long long)variant);
+		path += suffix;
+	}
+
+	return path + ".cooked";
+}
+
+unsigned int gl::loadProgramBinary(const string &path, uint64_t key)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+
+	if(!file)
+		return 0;
+
+	Header header;
+	vector<char> binary;
+
+	bool ok = fread(&header, sizeof(Header), 1, file) == 1 &&
+	!memcmp(header.magic, PROGRAM_MAGIC, 8) &&
+	header.version == PROGRAM_VERSION && header.key == key;
+
+	if(ok) {
+		binary.resize(header.size);
+		ok = fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+
+	fclose(file);
+
+	if(!ok)
+		return 0;
+
+	unsigned int program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), binary.size());
+
+	// drivers reject binaries of other builds even when the strings match
+	int linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	if(!linked) {
+		glState().deleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+bool gl::saveProgramBinary(const string &path, uint64_t key,
+unsigned int program)
+{
+	int size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+
+	if(size <= 0)
+		return false;
+
+	vector<char> binary(size);
+	GLenum format;
+	glGetProgramBinary(program, size, nullptr, &format, binary.data());
+
+	Header header;
+	memcpy(header.magic, PROGRAM_MAGIC, 8);
+	header.version = PROGRAM_VERSION;
+	header.format = format;
+	header.key = key;
+	header.size = binary.size();
+
+	// write next to the destination and rename, readers never see a
+	// partially written file
+	string tmpPath = path + ".tmp";
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+
+	if(!file)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(Header), 1, file) == 1 &&
+	fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+
+	ok = fclose(file) == 0 && ok;
+
+	if(ok) {
+		remove(path.c_str());
+		ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+
+	if(!ok)
+		remove(tmpPath.c_str());
+
+	return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace gl {
+	// Linked programs saved with glGetProgramBinary, so later runs skip
+	// compiling and linking. Binaries only work on the driver that made
+	// them, the key therefore covers the vendor, renderer and version
+	// strings next to the sources. Context thread only.
+
+	// key of a program built from sources on the current driver
+	uint64_t programKey(const std::vector<std::string> &sources);
+
+	// where the program of these two stages is cached, next to the
+	// vertex shader. Permutations of the same sources pass a non zero
+	// variant to get files of their own.
+	std::string programCachePath(const std::string &vertexPath,
+	const std::string &fragmentPath, uint64_t variant = 0);
+
+	// program created from the binary at path, 0 when it is missing,
+	// stale or rejected by the driver
+	unsigned int loadProgramBinary(const std::string &path, uint64_t key);
+
+	// program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	bool saveProgramBinary(const std::string &path, uint64_t key,
+	unsigned int program);
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,356 @@
+#include "shader_library.h"
+#include "program_cache.h"
+#include "hash.h"
+
+#include <set>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+using namespace gl;
+using namespace std;
+
+static bool readFile(const string &path, string &text)
+{
+	ifstream file(path);
+
+	if(!file)
+		return false;
+
+	stringstream buffer;
+	buffer << file.rdbuf();
+	text = buffer.str();
+
+	return true;
+}
+
+static string directoryOf(const string &path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+static bool expand(const string &path, set<string> &included, string &out)
+{
+	string text;
+
+	if(!readFile(path, text)) {
+		cerr << "Unable to read shader " << path << endl;
+		return false;
+	}
+
+	included.insert(path);
+
+	istringstream lines(text);
+	string line;
+	int number = 0;
+
+	while(getline(lines, line)) {
+		number++;
+
+		size_t start = line.find_first_not_of(" \t");
+
+		if(start == string::npos || line.compare(start, 8, "#include")) {
+			out += line;
+			out += '\n';
+			continue;
+		}
+
+		size_t open = line.find('"', start);
+		size_t close = open == string::npos ? open : line.find('"', open + 1);
+
+		if(close == string::npos) {
+			cerr << path << ":" << number << ": malformed #include" << endl;
+			return false;
+		}
+
+		string file = directoryOf(path) + line.substr(open + 1, close - open - 1);
+
+		// include guards for free, a second include is dropped
+		if(!included.count(file)) {
+			out += "#line 1\n";
+
+			if(!expand(file, included, out))
+				return false;
+		}
+
+		out += "#line " + to_string(number + 1) + "\n";
+	}
+
+	return true;
+}
+
+bool gl::preprocessShader(const string &path, const vector<string> &defines,
+string &source)
+{
+	string text;
+	set<string> included;
+
+	if(!expand(path, included, text))
+		return false;
+
+	// defines go right after #version, which must stay first
+	size_t first = text.find_first_not_of(" \t\r\n");
+	size_t insert = 0;
+
+	if(first != string::npos && !text.compare(first, 8, "#version")) {
+		insert = text.find('\n', text.find("#version"));
+		insert = insert == string::npos ? text.size() : insert + 1;
+	}
+
+	string header;
+
+	for(const string &define : defines)
+		header += "#define " + define + "\n";
+
+	// the line after #version keeps its number
+	int versionLines = count(text.begin(), text.begin() + insert, '\n');
+
+	if(header.size())
+		header += "#line " + to_string(versionLines + 1) + "\n";
+
+	source = text.substr(0, insert) + header + text.substr(insert);
+
+	return true;
+}
+
+static uint64_t milliseconds()
+{
+	return chrono::duration_cast<chrono::milliseconds>(
+	chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned int compileStage(GLenum type, const string &source)
+{
+	unsigned int shader = glCreateShader(type);
+	const char *src = source.c_str();
+
+	// statuses are only queried once the program is done, querying now
+	// would wait for the compiler
+	glShaderSource(shader, 1, &src, NULL);
+	glCompileShader(shader);
+
+	return shader;
+}
+
+static void printLog(unsigned int object, bool program, const string &name)
+{
+	char infoLog[1024];
+
+	if(program)
+		glGetProgramInfoLog(object, sizeof(infoLog), NULL, infoLog);
+	else
+		glGetShaderInfoLog(object, sizeof(infoLog), NULL, infoLog);
+
+	cout << "ERROR::SHADER::" << (program ? "LINKING" : "COMPILATION") <<
+	"_FAILED " << name << "\n" << infoLog << endl;
+}
+
+ShaderLibrary::ShaderLibrary()
+{
+	m_parallel = GLEW_KHR_parallel_shader_compile;
+
+	// let the driver pick the number of compiler threads
+	if(m_parallel)
+		glMaxShaderCompilerThreadsKHR(0xffffffff);
+}
+
+ShaderLibrary::~ShaderLibrary()
+{
+	// programs die with the context, clear() deletes them before that
+}
+
+ShaderHandle ShaderLibrary::request(const char *vertexPath,
+const char *fragmentPath, const vector<string> &defines)
+{
+	uint64_t id = fnv1a(fragmentPath, fnv1a(vertexPath));
+
+	for(const string &define : defines)
+		id = fnv1a(define.c_str(), mix64(id));
+
+	auto it = m_byKey.find(id);
+
+	if(it != m_byKey.end())
+		return it->second;
+
+	m_variants.push_back(Variant());
+	ShaderHandle handle = m_variants.size();
+	m_byKey[id] = handle;
+
+	Variant &variant = m_variants.back();
+	variant.name = string(vertexPath) + " " + fragmentPath;
+
+	for(const string &define : defines)
+		variant.name += " " + define;
+
+	string vertex, fragment;
+
+	if(!preprocessShader(vertexPath, defines, vertex) ||
+	!preprocessShader(fragmentPath, defines, fragment)) {
+		variant.state = FAILED;
+		return handle;
+	}
+
+	// every permutation has its own binary next to the vertex shader
+	variant.key = programKey({vertex, fragment});
+	variant.cachePath = programCachePath(vertexPath, fragmentPath,
+	defines.size() ? id : 0);
+
+	variant.program = loadProgramBinary(variant.cachePath, variant.key);
+
+	if(variant.program) {
+		variant.shader.reset(new Shader(variant.program));
+		variant.state = READY;
+		return handle;
+	}
+
+	if(!m_pending) {
+		m_batchStart = milliseconds();
+		m_batchSize = 0;
+	}
+
+	variant.vertex = compileStage(GL_VERTEX_SHADER, vertex);
+	variant.fragment = compileStage(GL_FRAGMENT_SHADER, fragment);
+
+	variant.program = glCreateProgram();
+	glProgramParameteri(variant.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+	GL_TRUE);
+
+	glAttachShader(variant.program, variant.vertex);
+	glAttachShader(variant.program, variant.fragment);
+	glLinkProgram(variant.program);
+
+	m_pending++;
+	m_batchSize++;
+
+	return handle;
+}
+
+Shader *ShaderLibrary::get(ShaderHandle handle)
+{
+	if(!handle || handle > m_variants.size())
+		return nullptr;
+
+	Variant &variant = m_variants[handle - 1];
+
+	return variant.state == READY ? variant.shader.get() : nullptr;
+}
+
+bool ShaderLibrary::failed(ShaderHandle handle) const
+{
+	return handle && handle <= m_variants.size() &&
+	m_variants[handle - 1].state == FAILED;
+}
+
+void ShaderLibrary::poll()
+{
+	if(!m_pending)
+		return;
+
+	for(Variant &variant : m_variants) {
+		if(variant.state != COMPILING)
+			continue;
+
+		if(m_parallel) {
+			int done;
+			glGetProgramiv(variant.program, GL_COMPLETION_STATUS_KHR, &done);
+
+			if(!done)
+				continue;
+		}
+
+		complete(variant);
+
+		// the status query blocked, leave the rest to later frames
+		if(!m_parallel)
+			break;
+	}
+}
+
+void ShaderLibrary::finish()
+{
+	for(Variant &variant : m_variants) {
+		if(variant.state == COMPILING)
+			complete(variant);
+	}
+}
+
+size_t ShaderLibrary::pending() const
+{
+	return m_pending;
+}
+
+bool ShaderLibrary::parallel() const
+{
+	return m_parallel;
+}
+
+size_t ShaderLibrary::lastBatchSize() const
+{
+	return m_lastBatchSize;
+}
+
+uint64_t ShaderLibrary::lastBatchMilliseconds() const
+{
+	return m_lastBatchTime;
+}
+
+void ShaderLibrary::clear()
+{
+	for(Variant &variant : m_variants) {
+		if(variant.vertex)
+			glDeleteShader(variant.vertex);
+
+		if(variant.fragment)
+			glDeleteShader(variant.fragment);
+
+		if(variant.program)
+			glState().deleteProgram(variant.program);
+	}
+
+	m_variants.clear();
+	m_byKey.clear();
+	m_pending = 0;
+}
+
+void ShaderLibrary::complete(Variant &variant)
+{
+	int linked;
+	glGetProgramiv(variant.program, GL_LINK_STATUS, &linked);
+
+	if(linked) {
+		variant.shader.reset(new Shader(variant.program));
+		variant.state = READY;
+
+		if(!saveProgramBinary(variant.cachePath, variant.key, variant.program))
+			cerr << "Unable to write program cache " << variant.cachePath << endl;
+	} else {
+		int compiled;
+
+		for(unsigned int stage : {variant.vertex, variant.fragment}) {
+			glGetShaderiv(stage, GL_COMPILE_STATUS, &compiled);
+
+			if(!compiled)
+				printLog(stage, false, variant.name);
+		}
+
+		printLog(variant.program, true, variant.name);
+
+		glState().deleteProgram(variant.program);
+		variant.program = 0;
+		variant.state = FAILED;
+	}
+
+	glDeleteShader(variant.vertex);
+	glDeleteShader(variant.fragment);
+
+	variant.vertex = 0;
+	variant.fragment = 0;
+
+	if(!--m_pending) {
+		m_lastBatchSize = m_batchSize;
+		m_lastBatchTime = milliseconds() - m_batchStart;
+	}
+}
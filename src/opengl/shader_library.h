@@ -0,0 +1,101 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+
+#include "opengl.h"
+
+namespace gl {
+	// Read a GLSL file, inlining every #include "file" (relative to the
+	// including file, each file at most once) and adding a #define for
+	// each of defines ("NAME" or "NAME value") after the #version line.
+	// #line directives keep compiler messages pointing at source lines.
+	bool preprocessShader(const std::string &path,
+	const std::vector<std::string> &defines, std::string &source);
+
+	// index + 1 of a library variant, 0 is never a valid handle
+	typedef uint32_t ShaderHandle;
+
+	// Shader variants built from shared sources and #define permutations.
+	// request() starts compiling at once and returns; with
+	// GL_KHR_parallel_shader_compile the driver builds every requested
+	// variant on its own threads, and poll() picks up the finished ones
+	// without waiting. Without it poll() finishes one variant per call.
+	// Variants come from the program binary cache when possible.
+	// Context thread only.
+	class ShaderLibrary {
+		public:
+			ShaderLibrary();
+			~ShaderLibrary();
+
+			ShaderLibrary(const ShaderLibrary &) = delete;
+			ShaderLibrary &operator=(const ShaderLibrary &) = delete;
+
+			// the same sources and defines give the same handle
+			ShaderHandle request(const char *vertexPath,
+			const char *fragmentPath,
+			const std::vector<std::string> &defines = {});
+
+			// linked variant, nullptr while compiling or when it failed
+			Shader *get(ShaderHandle handle);
+			bool failed(ShaderHandle handle) const;
+
+			// finish variants the driver is done with, once per frame
+			void poll();
+
+			// block until every requested variant is finished
+			void finish();
+
+			// variants requested and not finished
+			size_t pending() const;
+
+			// whether the driver compiles in the background
+			bool parallel() const;
+
+			// variants of the last finished batch of requests, and the time
+			// from its first request until its last variant was done
+			size_t lastBatchSize() const;
+			uint64_t lastBatchMilliseconds() const;
+
+			// delete every program, the context must be current
+			void clear();
+
+		private:
+			enum State { COMPILING, READY, FAILED };
+
+			struct Variant {
+				std::string name; // for messages
+				std::string cachePath;
+				uint64_t key;
+
+				unsigned int vertex = 0;
+				unsigned int fragment = 0;
+				unsigned int program = 0;
+
+				State state = COMPILING;
+				std::unique_ptr<Shader> shader;
+			};
+
+			std::vector<Variant> m_variants;
+			std::unordered_map<uint64_t, ShaderHandle> m_byKey;
+
+			bool m_parallel;
+			size_t m_pending = 0;
+
+			// time the current batch of requests started compiling
+			uint64_t m_batchStart = 0;
+			size_t m_batchSize = 0;
+
+			size_t m_lastBatchSize = 0;
+			uint64_t m_lastBatchTime = 0;
+
+			void complete(Variant &variant);
+	};
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,200 @@
+#include "staging.h"
+#include "state_cache.h"
+
+#include <cstring>
+
+using namespace gl;
+
+static bool overlaps(size_t aBegin, size_t aEnd, size_t bBegin, size_t bEnd)
+{
+	return aBegin < bEnd && bBegin < aEnd;
+}
+
+// segments may wrap around the end of the ring, split them in two
+static bool overlapsCircular(size_t begin, size_t end, size_t segBegin,
+size_t segEnd, size_t capacity)
+{
+	if(segBegin == segEnd)
+		return false;
+
+	if(segBegin < segEnd)
+		return overlaps(begin, end, segBegin, segEnd);
+
+	return overlaps(begin, end, segBegin, capacity) ||
+	overlaps(begin, end, 0, segEnd);
+}
+
+StagingRing::StagingRing(size_t capacity) : m_capacity(capacity)
+{
+
+}
+
+StagingRing::~StagingRing()
+{
+
+}
+
+void StagingRing::init()
+{
+	glGenBuffers(1, &m_buffer);
+	glState().bindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+
+	if(GLEW_ARB_buffer_storage) {
+		// persistent coherent mapping, no map/unmap per upload
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+		GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_COPY_READ_BUFFER, m_capacity, nullptr, flags);
+		m_mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0,
+		m_capacity, flags);
+	} else {
+		glBufferData(GL_COPY_READ_BUFFER, m_capacity, nullptr, GL_STREAM_COPY);
+	}
+
+	glState().bindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+bool StagingRing::upload(unsigned int dst, size_t dstOffset, const void *data,
+size_t size)
+{
+	if(!m_buffer)
+		init();
+
+	size_t offset;
+
+	if(!allocate(size, offset))
+		return false;
+
+	glState().bindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+
+	if(m_mapped) {
+		memcpy(m_mapped + offset, data, size);
+	} else {
+		// the range was already waited on, skip driver synchronization
+		void *dest = glMapBufferRange(GL_COPY_READ_BUFFER, offset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+		GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if(!dest) {
+			glState().bindBuffer(GL_COPY_READ_BUFFER, 0);
+			return false;
+		}
+
+		memcpy(dest, data, size);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+
+	// COPY_WRITE leaves the element array binding of the bound VAO alone
+	glState().bindBuffer(GL_COPY_WRITE_BUFFER, dst);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+	offset, dstOffset, size);
+
+	glState().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glState().bindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return true;
+}
+
+bool StagingRing::allocate(size_t size, size_t &offset)
+{
+	if(!size || size > m_capacity)
+		return false;
+
+	// keep copies 16 bytes aligned
+	size_t head = (m_head + 15) & ~size_t(15);
+
+	if(head + size > m_capacity)
+		head = 0;
+
+	// wrapped onto data written earlier this frame, fence it so it can be
+	// waited on like any other frame
+	if(overlapsCircular(head, head + size, m_frameBegin, m_head, m_capacity))
+		endFrame();
+
+	waitFor(head, head + size);
+
+	offset = head;
+	m_head = head + size;
+
+	return true;
+}
+
+void StagingRing::waitFront()
+{
+	Segment &seg = m_inFlight.front();
+
+	GLenum res = glClientWaitSync(seg.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+	while(res == GL_TIMEOUT_EXPIRED)
+		res = glClientWaitSync(seg.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+	glDeleteSync(seg.fence);
+	m_inFlight.pop_front();
+}
+
+void StagingRing::waitFor(size_t begin, size_t end)
+{
+	// segments retire in order, wait on the oldest until the range is free
+	bool busy = true;
+
+	while(busy) {
+		busy = false;
+
+		for(const Segment &seg : m_inFlight) {
+			if(overlapsCircular(begin, end, seg.begin, seg.end, m_capacity)) {
+				busy = true;
+				break;
+			}
+		}
+
+		if(busy)
+			waitFront();
+	}
+}
+
+void StagingRing::endFrame()
+{
+	if(!m_buffer || m_head == m_frameBegin)
+		return;
+
+	Segment seg;
+	seg.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	seg.begin = m_frameBegin;
+	seg.end = m_head;
+
+	m_inFlight.push_back(seg);
+	m_frameBegin = m_head;
+}
+
+void StagingRing::release()
+{
+	while(m_inFlight.size()) {
+		glDeleteSync(m_inFlight.front().fence);
+		m_inFlight.pop_front();
+	}
+
+	if(m_buffer) {
+		if(m_mapped) {
+			glState().bindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+			glState().bindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+
+		glState().deleteBuffers(1, &m_buffer);
+	}
+
+	m_buffer = 0;
+	m_mapped = nullptr;
+	m_head = m_frameBegin = 0;
+}
+
+size_t StagingRing::capacity() const
+{
+	return m_capacity;
+}
+
+StagingRing &gl::stagingRing()
+{
+	static StagingRing ring;
+	return ring;
+}
@@ -0,0 +1,60 @@
+#ifndef STAGING_H
+#define STAGING_H
+
+#include <cstddef>
+#include <deque>
+
+#include <GL/glew.h>
+
+namespace gl {
+	// Ring of write-only staging memory used to stream buffer updates
+	// without stalling on buffers the GPU may still be reading. Data is
+	// written into the ring and copied on the GPU into its destination;
+	// every frame is fenced so wrapping around only waits on frames that
+	// are actually still in flight.
+	class StagingRing {
+		public:
+			StagingRing(size_t capacity = 8 * 1024 * 1024);
+			~StagingRing();
+
+			// copy size bytes of data into buffer dst at dstOffset, returns
+			// false if the upload does not fit the ring and was not performed
+			bool upload(unsigned int dst, size_t dstOffset, const void *data,
+			size_t size);
+
+			// fence everything written since the previous call
+			void endFrame();
+
+			// delete GL objects, must run while the context is still current
+			void release();
+
+			size_t capacity() const;
+
+		private:
+			struct Segment {
+				GLsync fence;
+				size_t begin;
+				size_t end;
+			};
+
+			void init();
+			bool allocate(size_t size, size_t &offset);
+			void waitFor(size_t begin, size_t end);
+			void waitFront();
+
+			unsigned int m_buffer = 0;
+			unsigned char *m_mapped = nullptr;
+
+			size_t m_capacity;
+			size_t m_head = 0;
+			size_t m_frameBegin = 0;
+
+			std::deque<Segment> m_inFlight;
+	};
+
+	// ring shared by all meshes of the current context
+	StagingRing &stagingRing();
+
+} // namespace gl
+
+#endif
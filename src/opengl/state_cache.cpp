@@ -0,0 +1,221 @@
+#include "state_cache.h"
+#include "opengl.h"
+
+using namespace gl;
+
+// count a call that reached the driver, or one that was dropped
+static inline void passed()
+{
+	frameStats().stateCalls++;
+}
+
+static inline void elided()
+{
+	frameStats().stateElided++;
+}
+
+StateCache::StateCache()
+{
+	invalidate();
+}
+
+void StateCache::useProgram(unsigned int program)
+{
+	if(program == m_program) {
+		elided();
+		return;
+	}
+
+	glUseProgram(program);
+	m_program = program;
+	passed();
+}
+
+void StateCache::bindVertexArray(unsigned int vao)
+{
+	if(vao == m_vao) {
+		elided();
+		return;
+	}
+
+	glBindVertexArray(vao);
+	m_vao = vao;
+	passed();
+
+	// the element buffer binding belongs to the vertex array
+	m_buffers[bufferIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+}
+
+void StateCache::bindBuffer(GLenum target, unsigned int buffer)
+{
+	int index = bufferIndex(target);
+
+	if(index >= 0 && m_buffers[index] == buffer) {
+		elided();
+		return;
+	}
+
+	glBindBuffer(target, buffer);
+	passed();
+
+	if(index >= 0)
+		m_buffers[index] = buffer;
+}
+
+void StateCache::activeTexture(GLenum unit)
+{
+	if(unit - GL_TEXTURE0 == m_unit) {
+		elided();
+		return;
+	}
+
+	glActiveTexture(unit);
+	m_unit = unit - GL_TEXTURE0;
+	passed();
+}
+
+void StateCache::bindTexture(GLenum target, unsigned int texture)
+{
+	bool cached = target == GL_TEXTURE_2D && m_unit < TEXTURE_UNITS;
+
+	if(cached && m_textures[m_unit] == texture) {
+		elided();
+		return;
+	}
+
+	glBindTexture(target, texture);
+	frameStats().textureBinds++;
+	passed();
+
+	if(cached)
+		m_textures[m_unit] = texture;
+}
+
+void StateCache::enable(GLenum cap)
+{
+	setCap(cap, true);
+}
+
+void StateCache::disable(GLenum cap)
+{
+	setCap(cap, false);
+}
+
+void StateCache::deleteBuffers(size_t count, const unsigned int *buffers)
+{
+	for(size_t i = 0; i < count; ++i) {
+		for(unsigned int &bound : m_buffers) {
+			if(bound == buffers[i])
+				bound = 0;
+		}
+	}
+
+	glDeleteBuffers(count, buffers);
+}
+
+void StateCache::deleteTextures(size_t count, const unsigned int *textures)
+{
+	for(size_t i = 0; i < count; ++i) {
+		for(unsigned int &bound : m_textures) {
+			if(bound == textures[i])
+				bound = 0;
+		}
+	}
+
+	glDeleteTextures(count, textures);
+}
+
+void StateCache::deleteVertexArrays(size_t count, const unsigned int *vaos)
+{
+	for(size_t i = 0; i < count; ++i) {
+		if(m_vao == vaos[i]) {
+			m_vao = 0;
+			m_buffers[bufferIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+		}
+	}
+
+	glDeleteVertexArrays(count, vaos);
+}
+
+void StateCache::deleteProgram(unsigned int program)
+{
+	// a program in use stays alive until unbound, the name is what
+	// matters here
+	if(m_program == program)
+		m_program = UNKNOWN;
+
+	glDeleteProgram(program);
+}
+
+void StateCache::invalidate()
+{
+	m_program = UNKNOWN;
+	m_vao = UNKNOWN;
+	m_unit = UNKNOWN;
+
+	for(unsigned int &buffer : m_buffers)
+		buffer = UNKNOWN;
+
+	for(unsigned int &texture : m_textures)
+		texture = UNKNOWN;
+
+	for(int8_t &cap : m_caps)
+		cap = -1;
+}
+
+int StateCache::bufferIndex(GLenum target)
+{
+	switch(target) {
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_ELEMENT_ARRAY_BUFFER: return 1;
+	case GL_COPY_READ_BUFFER: return 2;
+	case GL_COPY_WRITE_BUFFER: return 3;
+	case GL_PIXEL_UNPACK_BUFFER: return 4;
+	case GL_PIXEL_PACK_BUFFER: return 5;
+	case GL_UNIFORM_BUFFER: return 6;
+	}
+
+	return -1;
+}
+
+int StateCache::capIndex(GLenum cap)
+{
+	switch(cap) {
+	case GL_DEPTH_TEST: return 0;
+	case GL_BLEND: return 1;
+	case GL_CULL_FACE: return 2;
+	case GL_SCISSOR_TEST: return 3;
+	case GL_STENCIL_TEST: return 4;
+	case GL_POLYGON_OFFSET_FILL: return 5;
+	case GL_MULTISAMPLE: return 6;
+	case GL_FRAMEBUFFER_SRGB: return 7;
+	}
+
+	return -1;
+}
+
+void StateCache::setCap(GLenum cap, bool on)
+{
+	int index = capIndex(cap);
+
+	if(index >= 0 && m_caps[index] == on) {
+		elided();
+		return;
+	}
+
+	if(on)
+		glEnable(cap);
+	else
+		glDisable(cap);
+
+	passed();
+
+	if(index >= 0)
+		m_caps[index] = on;
+}
+
+StateCache &gl::glState()
+{
+	static StateCache state;
+	return state;
+}
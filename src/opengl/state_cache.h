@@ -0,0 +1,64 @@
+#ifndef STATE_CACHE_H
+#define STATE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+namespace gl {
+	// Shadow of the GL binding state, engine code binds through it so a
+	// bind of what is already bound never reaches the driver. Tracks the
+	// program, vertex array, the common buffer targets, GL_TEXTURE_2D per
+	// texture unit and glEnable() caps; anything else goes straight
+	// through. Code changing state behind its back must call invalidate().
+	// Context thread only.
+	class StateCache {
+		public:
+			StateCache();
+
+			void useProgram(unsigned int program);
+			void bindVertexArray(unsigned int vao);
+			void bindBuffer(GLenum target, unsigned int buffer);
+			void activeTexture(GLenum unit);
+			void bindTexture(GLenum target, unsigned int texture);
+			void enable(GLenum cap);
+			void disable(GLenum cap);
+
+			// delete and forget bindings of the deleted names, so a
+			// recycled name gets bound again
+			void deleteBuffers(size_t count, const unsigned int *buffers);
+			void deleteTextures(size_t count, const unsigned int *textures);
+			void deleteVertexArrays(size_t count, const unsigned int *vaos);
+			void deleteProgram(unsigned int program);
+
+			// forget everything, the next call of each kind goes through
+			void invalidate();
+
+		private:
+			enum {
+				BUFFER_TARGETS = 7,
+				TEXTURE_UNITS = 32,
+				CAPS = 8
+			};
+
+			// never a GL name, marks bindings the cache doesn't know
+			static const unsigned int UNKNOWN = 0xffffffffu;
+
+			unsigned int m_program;
+			unsigned int m_vao;
+			unsigned int m_buffers[BUFFER_TARGETS];
+			unsigned int m_unit; // index of the active texture unit
+			unsigned int m_textures[TEXTURE_UNITS];
+			int8_t m_caps[CAPS]; // -1 unknown
+
+			static int bufferIndex(GLenum target);
+			static int capIndex(GLenum cap);
+			void setCap(GLenum cap, bool on);
+	};
+
+	StateCache &glState();
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,319 @@
+#include "texture_atlas.h"
+#include "image_decoder.h"
+#include "mapped_file.h"
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../imgui/imstb_rectpack.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace gl;
+using namespace std;
+
+struct TextureAtlas::Page {
+	unsigned int texture = 0;
+	stbrp_context context;
+	vector<stbrp_node> nodes;
+};
+
+TextureAtlas::TextureAtlas(int pageSize, int maxImageSize, int padding) :
+m_pageSize(pageSize), m_maxImageSize(std::min(maxImageSize,
+pageSize - 2 * padding)), m_padding(padding)
+{
+
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	// pages die with the context, clear() deletes them before that
+}
+
+AtlasHandle TextureAtlas::add(const char *path)
+{
+	auto it = m_byPath.find(path);
+
+	if(it != m_byPath.end())
+		return it->second;
+
+	MappedFile file;
+
+	if(!file.open(path)) {
+		cerr << "Unable to read atlas image " << path << endl;
+		return 0;
+	}
+
+	int w, h, ch;
+	unsigned char *pixels = decodeImage(file.data(), file.size(), true, w, h,
+	ch);
+
+	if(!pixels) {
+		cerr << "Unable to decode atlas image " << path << endl;
+		return 0;
+	}
+
+	AtlasHandle handle = add(pixels, w, h, ch);
+	freeImage(pixels);
+
+	if(handle)
+		m_byPath[path] = handle;
+
+	return handle;
+}
+
+AtlasHandle TextureAtlas::add(const unsigned char *pixels, int width,
+int height, int channels)
+{
+	if(width > m_maxImageSize || height > m_maxImageSize)
+		return 0;
+
+	Pending image;
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+
+	// expand to RGBA8, grey and grey + alpha included
+	for(size_t i = 0; i < (size_t)width * height; ++i) {
+		const unsigned char *p = pixels + i * channels;
+		unsigned char *q = &image.pixels[i * 4];
+
+		q[0] = p[0];
+		q[1] = channels >= 3 ? p[1] : p[0];
+		q[2] = channels >= 3 ? p[2] : p[0];
+		q[3] = channels == 4 ? p[3] : channels == 2 ? p[1] : 255;
+	}
+
+	m_regions.push_back(AtlasRegion());
+	m_placed.push_back(false);
+
+	AtlasHandle handle = m_regions.size();
+	image.handle = handle;
+	m_pending.push_back(std::move(image));
+
+	return handle;
+}
+
+size_t TextureAtlas::update()
+{
+	if(m_pending.empty())
+		return 0;
+
+	vector<stbrp_rect> rects(m_pending.size());
+
+	for(size_t i = 0; i < m_pending.size(); ++i) {
+		rects[i].id = i;
+		rects[i].w = m_pending[i].width + 2 * m_padding;
+		rects[i].h = m_pending[i].height + 2 * m_padding;
+		rects[i].was_packed = 0;
+	}
+
+	// fill the free space of older pages before opening new ones, the
+	// packer keeps its skyline between calls
+	size_t page = 0;
+	size_t placed = 0;
+
+	while(rects.size()) {
+		Page &target = page < m_pages.size() ? *m_pages[page] : newPage();
+		stbrp_pack_rects(&target.context, rects.data(), rects.size());
+
+		glState().bindTexture(GL_TEXTURE_2D, target.texture);
+
+		for(const stbrp_rect &rect : rects) {
+			if(!rect.was_packed)
+				continue;
+
+			const Pending &image = m_pending[rect.id];
+			AtlasRegion &region = m_regions[image.handle - 1];
+
+			region.page = page;
+			region.x = rect.x + m_padding;
+			region.y = rect.y + m_padding;
+			region.width = image.width;
+			region.height = image.height;
+			region.offset = glm::vec2(region.x, region.y) / (float)m_pageSize;
+			region.scale = glm::vec2(region.width, region.height) /
+			(float)m_pageSize;
+
+			upload(image, rect.x, rect.y);
+
+			m_placed[image.handle - 1] = true;
+			placed++;
+		}
+
+		rects.erase(remove_if(rects.begin(), rects.end(),
+		[](const stbrp_rect &rect) { return rect.was_packed != 0; }),
+		rects.end());
+
+		page++;
+	}
+
+	glState().bindTexture(GL_TEXTURE_2D, 0);
+
+	m_pending.clear();
+
+	return placed;
+}
+
+bool TextureAtlas::ready(AtlasHandle handle) const
+{
+	return handle && handle <= m_placed.size() && m_placed[handle - 1];
+}
+
+const AtlasRegion &TextureAtlas::region(AtlasHandle handle) const
+{
+	return m_regions[handle - 1];
+}
+
+size_t TextureAtlas::pageCount() const
+{
+	return m_pages.size();
+}
+
+unsigned int TextureAtlas::pageTexture(size_t page) const
+{
+	return m_pages[page]->texture;
+}
+
+Texture TextureAtlas::texture(AtlasHandle handle, const char *type) const
+{
+	return Texture(pageTexture(region(handle).page), type, "atlas");
+}
+
+void TextureAtlas::remap(Vertex *vertices, size_t count,
+const AtlasRegion &region)
+{
+	for(size_t i = 0; i < count; ++i)
+		vertices[i].texCoords = region.offset + vertices[i].texCoords * region.scale;
+}
+
+bool TextureAtlas::pack(const vector<MaterialRef> &materials,
+const Vertex *vertices, size_t vertexCount, const unsigned int *indices,
+size_t indexCount, vector<AtlasHandle> &handles, vector<Vertex> &outVertices,
+vector<unsigned int> &outIndices)
+{
+	handles.assign(materials.size(), 0);
+	bool moved = false;
+
+	for(size_t m = 0; m < materials.size(); ++m) {
+		const MaterialRef &ref = materials[m];
+
+		if(ref.diffuseTexture.empty())
+			continue;
+
+		// wrapping texture coordinates need a texture of their own
+		bool inside = true;
+
+		for(size_t i = ref.firstIndex; inside && i < ref.firstIndex + ref.indexCount; ++i) {
+			const glm::vec2 &uv = vertices[indices[i]].texCoords;
+			inside = uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+		}
+
+		if(inside && (handles[m] = add(ref.diffuseTexture.c_str())))
+			moved = true;
+	}
+
+	if(!moved)
+		return false;
+
+	update();
+
+	outVertices.assign(vertices, vertices + vertexCount);
+	outIndices.assign(indices, indices + indexCount);
+
+	// image each vertex was remapped onto, a vertex reached by another
+	// material gets a copy for it
+	const AtlasHandle unused = ~AtlasHandle(0);
+	vector<AtlasHandle> owner(vertexCount, unused);
+	unordered_map<uint64_t, unsigned int> copies;
+
+	for(size_t m = 0; m < materials.size(); ++m) {
+		const MaterialRef &ref = materials[m];
+		AtlasHandle handle = handles[m];
+
+		for(size_t i = ref.firstIndex; i < ref.firstIndex + ref.indexCount; ++i) {
+			unsigned int v = indices[i];
+
+			if(owner[v] == unused) {
+				owner[v] = handle;
+
+				if(handle)
+					remap(&outVertices[v], 1, region(handle));
+			} else if(owner[v] != handle) {
+				uint64_t key = (uint64_t(v) << 32) | handle;
+				auto it = copies.find(key);
+
+				if(it == copies.end()) {
+					it = copies.emplace(key, outVertices.size()).first;
+					outVertices.push_back(vertices[v]);
+
+					if(handle)
+						remap(&outVertices.back(), 1, region(handle));
+				}
+
+				outIndices[i] = it->second;
+			}
+		}
+	}
+
+	return true;
+}
+
+void TextureAtlas::clear()
+{
+	for(auto &page : m_pages)
+		glState().deleteTextures(1, &page->texture);
+
+	m_pages.clear();
+	m_regions.clear();
+	m_placed.clear();
+	m_pending.clear();
+	m_byPath.clear();
+}
+
+TextureAtlas::Page &TextureAtlas::newPage()
+{
+	unique_ptr<Page> page(new Page);
+
+	// one node per column lets the packer reach every position
+	page->nodes.resize(m_pageSize);
+	stbrp_init_target(&page->context, m_pageSize, m_pageSize,
+	page->nodes.data(), page->nodes.size());
+
+	// padding only protects the full resolution, so no mip levels
+	glGenTextures(1, &page->texture);
+	glState().bindTexture(GL_TEXTURE_2D, page->texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, m_pageSize, m_pageSize);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	m_pages.push_back(std::move(page));
+
+	return *m_pages.back();
+}
+
+void TextureAtlas::upload(const Pending &image, int x, int y)
+{
+	int w = image.width + 2 * m_padding;
+	int h = image.height + 2 * m_padding;
+	vector<unsigned char> padded((size_t)w * h * 4);
+
+	// clamp every padded texel onto the nearest image texel
+	for(int py = 0; py < h; ++py) {
+		int sy = std::min(std::max(py - m_padding, 0), image.height - 1);
+
+		for(int px = 0; px < w; ++px) {
+			int sx = std::min(std::max(px - m_padding, 0), image.width - 1);
+
+			memcpy(&padded[((size_t)py * w + px) * 4],
+			&image.pixels[((size_t)sy * image.width + sx) * 4], 4);
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE,
+	padded.data());
+}
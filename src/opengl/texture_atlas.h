@@ -0,0 +1,110 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "opengl.h"
+
+namespace gl {
+	// where an image landed, offset + uv * scale maps its own texture
+	// coordinates in [0, 1] onto the page
+	struct AtlasRegion {
+		unsigned int page;
+		int x, y; // texels, inside the padding
+		int width, height;
+		glm::vec2 offset;
+		glm::vec2 scale;
+	};
+
+	// Packs small images into shared RGBA8 pages with stb_rect_pack, so
+	// meshes using any of them draw with a single texture bind. Images
+	// are queued by add() and packed into the free space of the existing
+	// pages by the next update(), a new page is opened only when nothing
+	// fits. Every image is surrounded by copies of its edge texels so
+	// linear filtering never picks up a neighbour; texture coordinates
+	// must stay in [0, 1], wrapping needs a texture of its own.
+	class TextureAtlas {
+		public:
+			TextureAtlas(int pageSize = 2048, int maxImageSize = 256,
+			int padding = 2);
+			~TextureAtlas();
+
+			TextureAtlas(const TextureAtlas &) = delete;
+			TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+			// decode and queue path, the same path gives the same handle.
+			// 0 when it can't be read or is larger than maxImageSize
+			AtlasHandle add(const char *path);
+			AtlasHandle add(const unsigned char *pixels, int width, int height,
+			int channels);
+
+			// pack and upload every queued image, GL thread only, returns
+			// the number of images placed
+			size_t update();
+
+			// whether handle has been placed by update()
+			bool ready(AtlasHandle handle) const;
+			const AtlasRegion &region(AtlasHandle handle) const;
+
+			size_t pageCount() const;
+			unsigned int pageTexture(size_t page) const;
+
+			// the page of handle, owned by the atlas and not the texture
+			// cache
+			Texture texture(AtlasHandle handle, const char *type) const;
+
+			// move texture coordinates onto region
+			static void remap(Vertex *vertices, size_t count,
+			const AtlasRegion &region);
+
+			// Move the materials of a mesh whose diffuse texture fits onto
+			// the atlas. handles gets the image of every material, 0 where
+			// it keeps a texture of its own: too large, unreadable or with
+			// texture coordinates outside [0, 1]. outVertices and
+			// outIndices get a copy of the mesh with remapped coordinates,
+			// a vertex shared by two materials is duplicated. Returns false
+			// with neither written when no material moved. Packs with
+			// update(), GL thread only.
+			bool pack(const std::vector<MaterialRef> &materials,
+			const Vertex *vertices, size_t vertexCount,
+			const unsigned int *indices, size_t indexCount,
+			std::vector<AtlasHandle> &handles, std::vector<Vertex> &outVertices,
+			std::vector<unsigned int> &outIndices);
+
+			// delete every page, the context must be current
+			void clear();
+
+		private:
+			struct Page;
+
+			struct Pending {
+				AtlasHandle handle;
+				std::vector<unsigned char> pixels; // RGBA8
+				int width, height;
+			};
+
+			int m_pageSize;
+			int m_maxImageSize;
+			int m_padding;
+
+			std::vector<std::unique_ptr<Page>> m_pages;
+			std::vector<AtlasRegion> m_regions;
+			std::vector<bool> m_placed;
+			std::vector<Pending> m_pending;
+			std::unordered_map<std::string, AtlasHandle> m_byPath;
+
+			Page &newPage();
+
+			// write image and its edge padding at x, y of the bound page
+			void upload(const Pending &image, int x, int y);
+	};
+
+} // namespace gl
+
+#endif
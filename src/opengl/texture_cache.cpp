@@ -0,0 +1,302 @@
+#include "texture_cache.h"
+#include "opengl.h"
+#include "texture_cooker.h"
+#include "image_decoder.h"
+#include "jobs.h"
+
+#include <thread>
+#include <iostream>
+#include <algorithm>
+
+using namespace gl;
+using namespace std;
+
+// images decoded per thread before a batch uploads and frees them
+#define BATCH_IMAGES_PER_THREAD 2
+
+double TextureCache::Stats::hitRate() const
+{
+	size_t lookups = hits + misses;
+	return lookups ? (double)hits / lookups : 0.0;
+}
+
+TextureCache::TextureCache()
+{
+
+}
+
+TextureCache::~TextureCache()
+{
+	// GL objects die with the context, only forget about them here
+}
+
+const char *TextureCache::intern(const char *str)
+{
+	return m_strings.insert(str).first->c_str();
+}
+
+TextureHandle TextureCache::acquire(const char *path)
+{
+	const char *key = intern(path);
+	auto it = m_byPath.find(key);
+
+	if(it != m_byPath.end()) {
+		m_stats.hits++;
+		retain(it->second);
+		return it->second;
+	}
+
+	m_stats.misses++;
+
+	// mips and block compression, from the cooked copy when up to date
+	TextureData data;
+
+	if(!readTexture(path, compressedTexturesSupported(), data)) {
+		cerr << "Unable to load texture: " << path << endl;
+		exit(1);
+	}
+
+	return insert(key, createTexture(data), data.bytes(), false);
+}
+
+void TextureCache::acquireBatch(const vector<const char*> &paths,
+vector<TextureHandle> &handles)
+{
+	vector<const char*> keys;
+	vector<string> missing;
+	unordered_set<const char*> loaded;
+
+	for(const char *path : paths) {
+		const char *key = intern(path);
+		keys.push_back(key);
+
+		if(!m_byPath.count(key) && loaded.insert(key).second)
+			missing.push_back(key);
+	}
+
+	// a few images per thread at a time, holding every decoded image
+	// until the end made the batch slower than loading one by one
+	size_t threads = JobSystem::current() ? JobSystem::current()->threadCount() :
+	std::max(1u, thread::hardware_concurrency());
+	size_t group = threads * BATCH_IMAGES_PER_THREAD;
+
+	for(size_t first = 0; first < missing.size(); first += group) {
+		vector<string> paths(missing.begin() + first,
+		missing.begin() + std::min(missing.size(), first + group));
+		vector<unique_ptr<TextureData>> data;
+
+		readTextures(paths, compressedTexturesSupported(), data);
+
+		for(size_t i = 0; i < paths.size(); ++i) {
+			if(!data[i]) {
+				cerr << "Unable to load texture: " << paths[i] << endl;
+				exit(1);
+			}
+
+			m_stats.misses++;
+			insert(intern(paths[i].c_str()), createTexture(*data[i]),
+			data[i]->bytes(), false);
+		}
+	}
+
+	// the next batch may be far away, keep no decode buffers until then
+	if(missing.size())
+		trimDecodePool();
+
+	// a texture loaded here already holds the reference of its first use
+	handles.clear();
+
+	for(const char *key : keys) {
+		TextureHandle handle = m_byPath[key];
+
+		if(!loaded.erase(key)) {
+			m_stats.hits++;
+			retain(handle);
+		}
+
+		handles.push_back(handle);
+	}
+}
+
+TextureHandle TextureCache::acquireAsync(const char *path, bool &created)
+{
+	const char *key = intern(path);
+	auto it = m_byPath.find(key);
+
+	created = it == m_byPath.end();
+
+	if(!created) {
+		m_stats.hits++;
+		retain(it->second);
+		return it->second;
+	}
+
+	m_stats.misses++;
+
+	return insert(key, placeholder(), 0, true);
+}
+
+bool TextureCache::resolve(TextureHandle handle, const char *path,
+unsigned int id, size_t bytes)
+{
+	Entry *e = entry(handle);
+
+	// released, and maybe reused for another path
+	if(!e || !e->pending || e->path != intern(path))
+		return false;
+
+	e->id = id;
+	e->bytes = bytes;
+	e->pending = false;
+
+	m_stats.residentBytes += bytes;
+
+	return true;
+}
+
+void TextureCache::retain(TextureHandle handle)
+{
+	if(Entry *e = entry(handle))
+		e->references++;
+}
+
+void TextureCache::release(TextureHandle handle)
+{
+	Entry *e = entry(handle);
+
+	if(!e || --e->references)
+		return;
+
+	// pending entries share the placeholder
+	if(!e->pending)
+		glState().deleteTextures(1, &e->id);
+
+	m_byPath.erase(e->path);
+	m_stats.textures--;
+	m_stats.residentBytes -= e->bytes;
+
+	*e = Entry();
+	m_free.push_back(handle);
+}
+
+unsigned int TextureCache::glId(TextureHandle handle) const
+{
+	const Entry *e = entry(handle);
+	return e ? e->id : 0;
+}
+
+const char *TextureCache::path(TextureHandle handle) const
+{
+	const Entry *e = entry(handle);
+	return e ? e->path : "";
+}
+
+unsigned int TextureCache::references(TextureHandle handle) const
+{
+	const Entry *e = entry(handle);
+	return e ? e->references : 0;
+}
+
+bool TextureCache::pending(TextureHandle handle) const
+{
+	const Entry *e = entry(handle);
+	return e && e->pending;
+}
+
+unsigned int TextureCache::placeholder()
+{
+	if(!m_placeholder) {
+		static const unsigned char checker[] = {
+			255, 0, 255, 255,  64, 64, 64, 255,
+			64, 64, 64, 255,  255, 0, 255, 255
+		};
+
+		glGenTextures(1, &m_placeholder);
+		glState().bindTexture(GL_TEXTURE_2D, m_placeholder);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, checker);
+
+		glState().bindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	return m_placeholder;
+}
+
+const TextureCache::Stats &TextureCache::stats() const
+{
+	return m_stats;
+}
+
+void TextureCache::clear()
+{
+	for(Entry &e : m_entries) {
+		if(e.references && !e.pending)
+			glState().deleteTextures(1, &e.id);
+	}
+
+	if(m_placeholder)
+		glState().deleteTextures(1, &m_placeholder);
+
+	m_placeholder = 0;
+
+	m_entries.clear();
+	m_free.clear();
+	m_byPath.clear();
+
+	m_stats.textures = 0;
+	m_stats.residentBytes = 0;
+}
+
+TextureHandle TextureCache::insert(const char *path, unsigned int id,
+size_t bytes, bool pending)
+{
+	TextureHandle handle;
+
+	if(m_free.size()) {
+		handle = m_free.back();
+		m_free.pop_back();
+	} else {
+		m_entries.push_back(Entry());
+		handle = m_entries.size();
+	}
+
+	Entry &e = m_entries[handle - 1];
+	e.id = id;
+	e.path = path;
+	e.references = 1;
+	e.bytes = bytes;
+	e.pending = pending;
+
+	m_byPath[path] = handle;
+
+	m_stats.textures++;
+	m_stats.residentBytes += bytes;
+
+	return handle;
+}
+
+TextureCache::Entry *TextureCache::entry(TextureHandle handle)
+{
+	if(!handle || handle > m_entries.size() || !m_entries[handle - 1].references)
+		return nullptr;
+
+	return &m_entries[handle - 1];
+}
+
+const TextureCache::Entry *TextureCache::entry(TextureHandle handle) const
+{
+	if(!handle || handle > m_entries.size() || !m_entries[handle - 1].references)
+		return nullptr;
+
+	return &m_entries[handle - 1];
+}
+
+TextureCache &gl::textureCache()
+{
+	static TextureCache cache;
+	return cache;
+}
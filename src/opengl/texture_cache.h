@@ -0,0 +1,101 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gl {
+	// index + 1 of a cache slot, 0 is never a valid handle
+	typedef uint32_t TextureHandle;
+
+	// Process wide cache of textures loaded from files, keyed by interned
+	// path so every image is decoded and uploaded once no matter how many
+	// models use it. Entries are refcounted: acquire() adds a reference,
+	// release() drops one and deletes the GL texture with the last one.
+	// Must only be used from the thread owning the GL context.
+	class TextureCache {
+		public:
+			struct Stats {
+				size_t hits = 0;
+				size_t misses = 0;
+				size_t textures = 0;
+				size_t residentBytes = 0;
+
+				double hitRate() const;
+			};
+
+			TextureCache();
+			~TextureCache();
+
+			// stable pointer to a shared copy of str, equal strings give
+			// equal pointers
+			const char *intern(const char *str);
+
+			// load path or reference the already loaded texture
+			TextureHandle acquire(const char *path);
+
+			// acquire() of every path, the ones not loaded yet are decoded
+			// together on all cores, handles match paths one to one
+			void acquireBatch(const std::vector<const char*> &paths,
+			std::vector<TextureHandle> &handles);
+
+			// reference path without loading it, a new entry shows the
+			// placeholder until resolve() and sets created
+			TextureHandle acquireAsync(const char *path, bool &created);
+
+			// hand the texture loaded for a pending entry to the cache,
+			// false if the entry was released meanwhile and the caller
+			// still owns id
+			bool resolve(TextureHandle handle, const char *path, unsigned int id,
+			size_t bytes);
+
+			void retain(TextureHandle handle);
+			void release(TextureHandle handle);
+
+			unsigned int glId(TextureHandle handle) const;
+			const char *path(TextureHandle handle) const;
+			unsigned int references(TextureHandle handle) const;
+			bool pending(TextureHandle handle) const;
+
+			// 2x2 checker shown for textures still loading
+			unsigned int placeholder();
+
+			const Stats &stats() const;
+
+			// delete every texture, must run while the context is current
+			void clear();
+
+		private:
+			struct Entry {
+				unsigned int id;
+				const char *path;
+				unsigned int references;
+				size_t bytes;
+				bool pending;
+			};
+
+			std::unordered_set<std::string> m_strings;
+			std::unordered_map<const char*, TextureHandle> m_byPath;
+
+			std::vector<Entry> m_entries;
+			std::vector<TextureHandle> m_free;
+
+			Stats m_stats;
+			unsigned int m_placeholder = 0;
+
+			TextureHandle insert(const char *path, unsigned int id, size_t bytes,
+			bool pending);
+
+			Entry *entry(TextureHandle handle);
+			const Entry *entry(TextureHandle handle) const;
+	};
+
+	TextureCache &textureCache();
+
+} // namespace gl
+
+#endif
@@ -0,0 +1,727 @@
+#include "texture_cooker.h"
+#include "hash.h"
+#include "parallel.h"
+#include "image_decoder.h"
+#include "state_cache.h"
+
+#include <GL/glew.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+using namespace gl;
+using namespace std;
+
+#define COOKED_MAGIC "GLTEX\0\0"
+#define COOKED_VERSION 1
+#define COOKED_ALIGN 16
+
+// rows per thread when filtering, block rows per thread when compressing
+#define MIP_MIN_ROWS 32
+#define BLOCK_MIN_ROWS 8
+
+// pixels readTextures() decodes and cooks at once, about 14 bytes each
+// while in flight. A larger image goes alone.
+#define COOK_MAX_PIXELS (4u << 20)
+
+namespace {
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t format;
+		uint64_t sourceHash;
+		uint64_t sourceSize;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint32_t pad;
+	};
+
+	struct LevelRecord {
+		uint64_t offset;
+		uint64_t size;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// sRGB transfer function, both ways
+	struct GammaTables {
+		float toLinear[256];
+		unsigned char toSrgb[4096];
+
+		GammaTables()
+		{
+			for(int i = 0; i < 256; ++i) {
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f :
+				powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for(int i = 0; i < 4096; ++i) {
+				float l = i / 4095.0f;
+				float c = l <= 0.0031308f ? l * 12.92f :
+				1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	// pixels of the images being cooked, threads wait for room
+	class PixelBudget {
+		public:
+			void acquire(size_t pixels)
+			{
+				unique_lock<mutex> lock(m_mutex);
+
+				m_available.wait(lock, [&]() {
+					return !m_pixels || m_pixels + pixels <= COOK_MAX_PIXELS;
+				});
+
+				m_pixels += pixels;
+			}
+
+			void release(size_t pixels)
+			{
+				{
+					lock_guard<mutex> lock(m_mutex);
+					m_pixels -= pixels;
+				}
+
+				m_available.notify_all();
+			}
+
+		private:
+			mutex m_mutex;
+			condition_variable m_available;
+			size_t m_pixels = 0;
+	};
+}
+
+static const GammaTables &gamma()
+{
+	static GammaTables tables;
+	return tables;
+}
+
+static uint64_t align(uint64_t offset)
+{
+	return (offset + COOKED_ALIGN - 1) & ~uint64_t(COOKED_ALIGN - 1);
+}
+
+static size_t blockSize(TextureFormat format)
+{
+	return format == TEXTURE_BC1 ? 8 : 16;
+}
+
+static GLenum internalFormat(TextureFormat format)
+{
+	switch(format) {
+	case TEXTURE_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TEXTURE_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	default: return GL_RGBA8;
+	}
+}
+
+bool CookedTexture::open(const string &path, uint64_t sourceHash,
+uint64_t sourceSize)
+{
+	close();
+
+	if(!m_file.open(path))
+		return false;
+
+	const unsigned char *data = m_file.data();
+	size_t size = m_file.size();
+
+	if(size < sizeof(Header)) {
+		close();
+		return false;
+	}
+
+	const Header *header = (const Header*)data;
+
+	bool valid = memcmp(header->magic, COOKED_MAGIC, 8) == 0 &&
+	header->version == COOKED_VERSION && header->sourceHash == sourceHash &&
+	header->sourceSize == sourceSize &&
+	(header->format == TEXTURE_BC1 || header->format == TEXTURE_BC3) &&
+	sizeof(Header) + header->levelCount * sizeof(LevelRecord) <= size;
+
+	const LevelRecord *records = (const LevelRecord*)(data + sizeof(Header));
+
+	// reject truncated or corrupted files before handing out pointers
+	for(uint32_t i = 0; valid && i < header->levelCount; ++i)
+		valid = records[i].offset + records[i].size <= size;
+
+	if(!valid) {
+		close();
+		return false;
+	}
+
+	m_levelCount = header->levelCount;
+
+	return true;
+}
+
+void CookedTexture::close()
+{
+	m_file.close();
+	m_levelCount = 0;
+}
+
+TextureFormat CookedTexture::format() const
+{
+	return (TextureFormat)((const Header*)m_file.data())->format;
+}
+
+int CookedTexture::width() const
+{
+	return ((const Header*)m_file.data())->width;
+}
+
+int CookedTexture::height() const
+{
+	return ((const Header*)m_file.data())->height;
+}
+
+size_t CookedTexture::levelCount() const
+{
+	return m_levelCount;
+}
+
+TextureLevel CookedTexture::level(size_t index) const
+{
+	const LevelRecord &r = ((const LevelRecord*)(m_file.data() +
+	sizeof(Header)))[index];
+
+	return {m_file.data() + r.offset, (size_t)r.size, (int)r.width,
+	(int)r.height};
+}
+
+bool CookedTexture::write(const string &path, uint64_t sourceHash,
+uint64_t sourceSize, TextureFormat format, const vector<TextureLevel> &levels)
+{
+	Header header;
+	memcpy(header.magic, COOKED_MAGIC, 8);
+	header.version = COOKED_VERSION;
+	header.format = format;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.width = levels.size() ? levels[0].width : 0;
+	header.height = levels.size() ? levels[0].height : 0;
+	header.levelCount = levels.size();
+	header.pad = 0;
+
+	vector<LevelRecord> records(levels.size());
+	uint64_t offset = align(sizeof(Header) + levels.size() * sizeof(LevelRecord));
+
+	for(size_t i = 0; i < levels.size(); ++i) {
+		records[i].offset = offset;
+		records[i].size = levels[i].size;
+		records[i].width = levels[i].width;
+		records[i].height = levels[i].height;
+
+		offset = align(offset + levels[i].size);
+	}
+
+	// write next to the destination and rename, readers never see a
+	// partially written file
+	string tmpPath = path + ".tmp";
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+
+	if(!file)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(Header), 1, file) == 1;
+
+	if(records.size())
+		ok = ok && fwrite(records.data(), sizeof(LevelRecord), records.size(), file) == records.size();
+
+	static const char zeros[COOKED_ALIGN] = {};
+	uint64_t written = sizeof(Header) + records.size() * sizeof(LevelRecord);
+
+	for(size_t i = 0; ok && i < levels.size(); ++i) {
+		ok = fwrite(zeros, 1, records[i].offset - written, file) == records[i].offset - written;
+		ok = ok && fwrite(levels[i].data, 1, levels[i].size, file) == levels[i].size;
+		written = records[i].offset + levels[i].size;
+	}
+
+	ok = fclose(file) == 0 && ok;
+
+	if(ok) {
+		remove(path.c_str());
+		ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+
+	if(!ok)
+		remove(tmpPath.c_str());
+
+	return ok;
+}
+
+string CookedTexture::pathFor(const string &sourcePath)
+{
+	return sourcePath + ".cooked";
+}
+
+size_t TextureData::bytes() const
+{
+	size_t total = 0;
+
+	for(const TextureLevel &level : levels)
+		total += level.size;
+
+	return total;
+}
+
+// readTexture(), decodes wait for room in budget when given
+static bool readLimited(const string &path, bool compress, TextureData &data,
+PixelBudget *budget)
+{
+	MappedFile source;
+
+	if(!source.open(path))
+		return false;
+
+	uint64_t sourceHash = hashBytes(source.data(), source.size());
+	string cookedPath = CookedTexture::pathFor(path);
+
+	if(compress && data.cooked.open(cookedPath, sourceHash, source.size())) {
+		data.format = data.cooked.format();
+
+		for(size_t i = 0; i < data.cooked.levelCount(); ++i)
+			data.levels.push_back(data.cooked.level(i));
+
+		return true;
+	}
+
+	// decoded and cooked images are large, a batch only holds so many
+	int w, h, ch;
+	size_t pixels = 0;
+
+	if(budget && imageSize(source.data(), source.size(), w, h, ch)) {
+		pixels = (size_t)w * h;
+		budget->acquire(pixels);
+	}
+
+	// GL wants the bottom row first
+	unsigned char *image = decodeImage(source.data(), source.size(), true, w,
+	h, ch);
+
+	if(image) {
+		cookTexture(image, w, h, ch, compress, data);
+		freeImage(image);
+	}
+
+	if(pixels)
+		budget->release(pixels);
+
+	if(!image)
+		return false;
+
+	if(compress && !CookedTexture::write(cookedPath, sourceHash, source.size(),
+	data.format, data.levels))
+		cerr << "Unable to write texture cache " << cookedPath << endl;
+
+	return true;
+}
+
+bool gl::readTexture(const string &path, bool compress, TextureData &data)
+{
+	return readLimited(path, compress, data, nullptr);
+}
+
+void gl::readTextures(const vector<string> &paths, bool compress,
+vector<unique_ptr<TextureData>> &data)
+{
+	data.clear();
+	data.resize(paths.size());
+
+	atomic<size_t> next(0);
+	PixelBudget budget;
+
+	// image sizes vary too much for fixed chunks, every thread pulls from
+	// a shared counter instead. Mips and compression of one image run on
+	// its thread, the batch already fills the cores.
+	parallelFor(0, paths.size(), 1, [&](size_t, size_t) {
+		for(size_t i; (i = next++) < paths.size();) {
+			unique_ptr<TextureData> texture(new TextureData);
+
+			if(readLimited(paths[i], compress, *texture, &budget))
+				data[i] = std::move(texture);
+		}
+	});
+}
+
+// 2x2 box filter of an sRGB encoded RGBA8 image, done on linear values,
+// edges clamped. Alpha stays linear.
+static void downsample(const unsigned char *src, int w, int h,
+unsigned char *dst, int dw, int dh)
+{
+	const GammaTables &tables = gamma();
+
+	parallelFor(0, dh, MIP_MIN_ROWS, [&](size_t begin, size_t end) {
+		for(size_t y = begin; y < end; ++y) {
+			const unsigned char *row0 = src + (size_t)std::min<int>(2 * y, h - 1) * w * 4;
+			const unsigned char *row1 = src + (size_t)std::min<int>(2 * y + 1, h - 1) * w * 4;
+			unsigned char *out = dst + y * dw * 4;
+
+			for(int x = 0; x < dw; ++x) {
+				const unsigned char *a = row0 + std::min(2 * x, w - 1) * 4;
+				const unsigned char *b = row0 + std::min(2 * x + 1, w - 1) * 4;
+				const unsigned char *c = row1 + std::min(2 * x, w - 1) * 4;
+				const unsigned char *d = row1 + std::min(2 * x + 1, w - 1) * 4;
+
+				for(int i = 0; i < 3; ++i) {
+					float v = 0.25f * (tables.toLinear[a[i]] + tables.toLinear[b[i]] +
+					tables.toLinear[c[i]] + tables.toLinear[d[i]]);
+
+					out[x * 4 + i] = tables.toSrgb[(int)(std::min(v, 1.0f) * 4095.0f + 0.5f)];
+				}
+
+				out[x * 4 + 3] = (a[3] + b[3] + c[3] + d[3] + 2) / 4;
+			}
+		}
+	});
+}
+
+static inline uint16_t to565(const unsigned char *c)
+{
+	return (uint16_t)(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+static inline void from565(uint16_t v, int *c)
+{
+	c[0] = ((v >> 11) & 31) * 255 / 31;
+	c[1] = ((v >> 5) & 63) * 255 / 63;
+	c[2] = (v & 31) * 255 / 31;
+}
+
+// 4x4 texels of an RGBA8 image, edges clamped
+static void fetchBlock(const unsigned char *image, int w, int h, int bx,
+int by, unsigned char *block)
+{
+	for(int y = 0; y < 4; ++y) {
+		const unsigned char *row = image + (size_t)std::min(by * 4 + y, h - 1) * w * 4;
+
+		for(int x = 0; x < 4; ++x)
+			memcpy(block + (y * 4 + x) * 4, row + std::min(bx * 4 + x, w - 1) * 4, 4);
+	}
+}
+
+// color endpoints from the bounding box inset by 1/16 of its extent, then
+// the closest of the four palette entries for every texel
+static void encodeColorBlock(const unsigned char *block, unsigned char *out)
+{
+	unsigned char lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+
+	for(int i = 0; i < 16; ++i) {
+		for(int c = 0; c < 3; ++c) {
+			lo[c] = std::min(lo[c], block[i * 4 + c]);
+			hi[c] = std::max(hi[c], block[i * 4 + c]);
+		}
+	}
+
+	for(int c = 0; c < 3; ++c) {
+		int inset = (hi[c] - lo[c]) >> 4;
+		lo[c] += inset;
+		hi[c] -= inset;
+	}
+
+	uint16_t c0 = to565(hi), c1 = to565(lo);
+	uint32_t indices = 0;
+
+	if(c0 < c1)
+		std::swap(c0, c1);
+
+	if(c0 != c1) {
+		int palette[4][3];
+		from565(c0, palette[0]);
+		from565(c1, palette[1]);
+
+		for(int c = 0; c < 3; ++c) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for(int i = 0; i < 16; ++i) {
+			int best = 0, bestDistance = 1 << 30;
+
+			for(int p = 0; p < 4; ++p) {
+				int d = 0;
+
+				for(int c = 0; c < 3; ++c) {
+					int e = block[i * 4 + c] - palette[p][c];
+					d += e * e;
+				}
+
+				if(d < bestDistance) {
+					bestDistance = d;
+					best = p;
+				}
+			}
+
+			indices |= (uint32_t)best << (2 * i);
+		}
+	}
+
+	memcpy(out, &c0, 2);
+	memcpy(out + 2, &c1, 2);
+	memcpy(out + 4, &indices, 4);
+}
+
+// alpha endpoints are the extremes, eight interpolated values in between
+static void encodeAlphaBlock(const unsigned char *block, unsigned char *out)
+{
+	unsigned char a0 = 0, a1 = 255;
+
+	for(int i = 0; i < 16; ++i) {
+		a0 = std::max(a0, block[i * 4 + 3]);
+		a1 = std::min(a1, block[i * 4 + 3]);
+	}
+
+	uint64_t indices = 0;
+
+	if(a0 != a1) {
+		int palette[8] = {a0, a1};
+
+		for(int p = 1; p < 7; ++p)
+			palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+		for(int i = 0; i < 16; ++i) {
+			int best = 0, bestDistance = 256;
+
+			for(int p = 0; p < 8; ++p) {
+				int d = abs(block[i * 4 + 3] - palette[p]);
+
+				if(d < bestDistance) {
+					bestDistance = d;
+					best = p;
+				}
+			}
+
+			indices |= (uint64_t)best << (3 * i);
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+
+	for(int i = 0; i < 6; ++i)
+		out[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+static void compress(const unsigned char *image, int w, int h,
+TextureFormat format, unsigned char *out)
+{
+	int bw = (w + 3) / 4, bh = (h + 3) / 4;
+	size_t size = blockSize(format);
+
+	parallelFor(0, bh, BLOCK_MIN_ROWS, [&](size_t begin, size_t end) {
+		unsigned char block[64];
+
+		for(size_t by = begin; by < end; ++by) {
+			for(int bx = 0; bx < bw; ++bx) {
+				unsigned char *dst = out + (by * bw + bx) * size;
+
+				fetchBlock(image, w, h, bx, by, block);
+
+				if(format == TEXTURE_BC3) {
+					encodeAlphaBlock(block, dst);
+					encodeColorBlock(block, dst + 8);
+				} else {
+					encodeColorBlock(block, dst);
+				}
+			}
+		}
+	});
+}
+
+void gl::cookTexture(const unsigned char *pixels, int width, int height,
+int channels, bool compressed, TextureData &data)
+{
+	data.format = !compressed ? TEXTURE_RGBA8 :
+	channels == 2 || channels == 4 ? TEXTURE_BC3 : TEXTURE_BC1;
+
+	// one allocation, levels are written straight into it
+	vector<int> sizes;
+	size_t total = 0;
+
+	for(int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+		sizes.push_back(w);
+		sizes.push_back(h);
+
+		total += compressed ? (size_t)((w + 3) / 4) * ((h + 3) / 4) *
+		blockSize(data.format) : (size_t)w * h * 4;
+
+		if(w == 1 && h == 1)
+			break;
+	}
+
+	data.storage.resize(total);
+	data.levels.clear();
+
+	// Each level is filtered from the one before, so besides the result
+	// at most two RGBA8 levels are live. Uncompressed chains need none,
+	// the levels of the result are the RGBA8 images.
+	vector<unsigned char> image, next;
+	const unsigned char *current = pixels;
+
+	if(!compressed || channels != 4) {
+		size_t count = (size_t)width * height;
+		unsigned char *expanded = data.storage.data();
+
+		if(compressed) {
+			image.resize(count * 4);
+			expanded = image.data();
+		}
+
+		// expand to RGBA8, grey and grey + alpha included
+		for(size_t i = 0; i < count; ++i) {
+			const unsigned char *p = pixels + i * channels;
+			unsigned char *q = expanded + i * 4;
+
+			q[0] = p[0];
+			q[1] = channels >= 3 ? p[1] : p[0];
+			q[2] = channels >= 3 ? p[2] : p[0];
+			q[3] = channels == 4 ? p[3] : channels == 2 ? p[1] : 255;
+		}
+
+		current = expanded;
+	}
+
+	size_t offset = 0;
+
+	for(size_t i = 0; i < sizes.size() / 2; ++i) {
+		int w = sizes[2 * i], h = sizes[2 * i + 1];
+		unsigned char *level = data.storage.data() + offset;
+		size_t size = compressed ? (size_t)((w + 3) / 4) * ((h + 3) / 4) *
+		blockSize(data.format) : (size_t)w * h * 4;
+
+		if(compressed)
+			compress(current, w, h, data.format, level);
+
+		data.levels.push_back({level, size, w, h});
+		offset += size;
+
+		if(2 * (i + 1) == sizes.size())
+			break;
+
+		int dw = sizes[2 * i + 2], dh = sizes[2 * i + 3];
+
+		if(compressed) {
+			next.resize((size_t)dw * dh * 4);
+			downsample(current, w, h, next.data(), dw, dh);
+
+			image.swap(next);
+			current = image.data();
+		} else {
+			downsample(current, w, h, data.storage.data() + offset, dw, dh);
+			current = data.storage.data() + offset;
+		}
+	}
+}
+
+unsigned int gl::allocateTexture(const TextureData &data)
+{
+	unsigned int id;
+
+	glGenTextures(1, &id);
+	glState().bindTexture(GL_TEXTURE_2D, id);
+
+	glTexStorage2D(GL_TEXTURE_2D, data.levels.size(), internalFormat(data.format),
+	data.levels[0].width, data.levels[0].height);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, data.levels.size() - 1);
+
+	glState().bindTexture(GL_TEXTURE_2D, 0);
+
+	return id;
+}
+
+size_t gl::textureRowBytes(const TextureData &data, size_t level)
+{
+	const TextureLevel &l = data.levels[level];
+
+	if(data.format == TEXTURE_RGBA8)
+		return (size_t)l.width * 4;
+
+	return (size_t)((l.width + 3) / 4) * blockSize(data.format);
+}
+
+int gl::textureRowAlignment(const TextureData &data)
+{
+	return data.format == TEXTURE_RGBA8 ? 1 : 4;
+}
+
+size_t gl::uploadTextureRows(unsigned int texture, const TextureData &data,
+size_t level, int firstRow, int rows, unsigned int pixelBuffer)
+{
+	const TextureLevel &l = data.levels[level];
+	int alignment = textureRowAlignment(data);
+
+	rows = std::min(rows, l.height - firstRow);
+
+	// rows of a block compressed image come in groups of four
+	size_t offset = firstRow / alignment * textureRowBytes(data, level);
+	size_t size = (rows + alignment - 1) / alignment * textureRowBytes(data, level);
+
+	const unsigned char *src = l.data + offset;
+
+	// orphan the pixel buffer every slice, the driver keeps the old storage
+	// alive for transfers still in flight
+	if(pixelBuffer) {
+		glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+		void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+		if(dst)
+			memcpy(dst, src, size);
+
+		// source from the buffer, or client memory if the mapping failed
+		if(dst && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+			src = nullptr;
+		else
+			glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	glState().bindTexture(GL_TEXTURE_2D, texture);
+
+	if(data.format == TEXTURE_RGBA8)
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, firstRow, l.width, rows, GL_RGBA,
+		GL_UNSIGNED_BYTE, src);
+	else
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, firstRow, l.width, rows,
+		internalFormat(data.format), size, src);
+
+	glState().bindTexture(GL_TEXTURE_2D, 0);
+
+	if(pixelBuffer)
+		glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	return size;
+}
+
+unsigned int gl::createTexture(const TextureData &data)
+{
+	unsigned int id = allocateTexture(data);
+
+	for(size_t i = 0; i < data.levels.size(); ++i)
+		uploadTextureRows(id, data, i, 0, data.levels[i].height);
+
+	return id;
+}
+
+bool gl::compressedTexturesSupported()
+{
+	return GLEW_EXT_texture_compression_s3tc;
+}
@@ -0,0 +1,109 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "mapped_file.h"
+
+namespace gl {
+	enum TextureFormat {
+		TEXTURE_RGBA8 = 0, // uncompressed fallback, never cooked to disk
+		TEXTURE_BC1 = 1, // opaque sources
+		TEXTURE_BC3 = 2 // sources with alpha
+	};
+
+	struct TextureLevel {
+		const unsigned char *data;
+		size_t size;
+		int width;
+		int height;
+	};
+
+	// Cooked copy of an image stored next to its source as <source>.cooked:
+	// the full mip chain, block compressed in the GPU layout, so levels are
+	// uploaded straight from the mapped file.
+	//
+	// layout: header | level records | blobs
+	class CookedTexture {
+		public:
+			// map path and validate it against the source content hash
+			bool open(const std::string &path, uint64_t sourceHash,
+			uint64_t sourceSize);
+			void close();
+
+			TextureFormat format() const;
+			int width() const;
+			int height() const;
+
+			size_t levelCount() const;
+			TextureLevel level(size_t index) const;
+
+			static bool write(const std::string &path, uint64_t sourceHash,
+			uint64_t sourceSize, TextureFormat format,
+			const std::vector<TextureLevel> &levels);
+
+			static std::string pathFor(const std::string &sourcePath);
+
+		private:
+			MappedFile m_file;
+			size_t m_levelCount = 0;
+	};
+
+	// CPU side of a texture load, see readTexture(). Levels either point
+	// into the cooked file mapping or into storage.
+	struct TextureData {
+		CookedTexture cooked;
+		std::vector<unsigned char> storage;
+
+		TextureFormat format = TEXTURE_RGBA8;
+		std::vector<TextureLevel> levels;
+
+		// bytes of every level together
+		size_t bytes() const;
+	};
+
+	// Read the cooked copy of path, or decode it, build a gamma correct
+	// box filtered mip chain on all cores and block compress it, writing
+	// the cooked copy for next time. Without compress the RGBA8 chain is
+	// returned instead. Touches no GL state, safe on any thread.
+	bool readTexture(const std::string &path, bool compress, TextureData &data);
+
+	// readTexture() of every path on all cores, each thread taking the next
+	// image as it finishes one, as long as the images being decoded stay
+	// under a pixel limit. Entries of data that failed are left null.
+	void readTextures(const std::vector<std::string> &paths, bool compress,
+	std::vector<std::unique_ptr<TextureData>> &data);
+
+	// mip chain of an RGB(A) image, RGBA8 levels, or BC1/BC3 blocks
+	void cookTexture(const unsigned char *pixels, int width, int height,
+	int channels, bool compress, TextureData &data);
+
+	// GL side, context thread only
+
+	// storage for every level of data, trilinear filtering
+	unsigned int allocateTexture(const TextureData &data);
+
+	// bytes of one row of level, a row of blocks for compressed formats
+	size_t textureRowBytes(const TextureData &data, size_t level);
+
+	// rows per row of blocks, 1 for uncompressed formats
+	int textureRowAlignment(const TextureData &data);
+
+	// upload rows [firstRow, firstRow + rows) of level, staged through
+	// pixelBuffer when given. firstRow must be a multiple of the row
+	// alignment, returns bytes sent
+	size_t uploadTextureRows(unsigned int texture, const TextureData &data,
+	size_t level, int firstRow, int rows, unsigned int pixelBuffer = 0);
+
+	// allocate and upload every level at once
+	unsigned int createTexture(const TextureData &data);
+
+	// whether cooked (block compressed) textures can be used
+	bool compressedTexturesSupported();
+
+} // namespace gl
+
+#endif
@@ -2,9 +2,13 @@
 #define VOLUME_H
 
 #include <vector>
+#include <iostream>
+#include <cmath>
 
+#include <glm/vec4.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <glm/mat4x4.hpp>
 
 inline float lengthSq(const glm::vec3 &vec)
 {
@@ -49,7 +53,7 @@ struct Circle
 
 struct Sphere
 {
-    Sphere();
+    Sphere() : radius(0) {}
     Sphere(const glm::vec3 &center, float radius) :
         center(center),
         radius(radius)
@@ -182,9 +186,75 @@ struct Volume
     glm::vec3 max;
 };
 
+struct Frustum
+{
+    Frustum() {}
+
+    // planes of a view-projection matrix (Gribb/Hartmann), normals point
+    // inside and are normalized so sphere radii can be compared directly
+    Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 row[4];
+        for(int i = 0; i < 4; ++i)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                    viewProjection[2][i], viewProjection[3][i]);
+
+        planes[0] = row[3] + row[0]; // left
+        planes[1] = row[3] - row[0]; // right
+        planes[2] = row[3] + row[1]; // bottom
+        planes[3] = row[3] - row[1]; // top
+        planes[4] = row[3] + row[2]; // near
+        planes[5] = row[3] - row[2]; // far
+
+        for(glm::vec4 &p : planes)
+            p /= sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+    }
+
+    float distance(int plane, const glm::vec3 &point) const
+    {
+        const glm::vec4 &p = planes[plane];
+        return p[0]*point[0] + p[1]*point[1] + p[2]*point[2] + p[3];
+    }
+
+    bool intersect(const glm::vec3 &point) const
+    {
+        for(int i = 0; i < 6; ++i)
+            if(distance(i, point) < 0)
+                return false;
+        return true;
+    }
+
+    bool intersect(const Sphere &sphere) const
+    {
+        for(int i = 0; i < 6; ++i)
+            if(distance(i, sphere.center) < -sphere.radius)
+                return false;
+        return true;
+    }
+
+    bool intersect(const Volume &volume) const
+    {
+        // test the box corner furthest along each plane normal
+        for(int i = 0; i < 6; ++i) {
+            const glm::vec4 &p = planes[i];
+            glm::vec3 corner(p[0] >= 0 ? volume.max[0] : volume.min[0],
+                    p[1] >= 0 ? volume.max[1] : volume.min[1],
+                    p[2] >= 0 ? volume.max[2] : volume.min[2]);
+
+            if(distance(i, corner) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    glm::vec4 planes[6];
+};
+
 #include <set>
 #include <map>
 
+#include "parallel.h"
+
 template <class T>
 struct SPNode {
 public:
@@ -257,14 +327,41 @@ public:
 
     void update(size_t id, T &volume)
     {
-        // remove from current nodes
-        auto it = items.find(id);
-        for (auto& kv : it->second.address) {
-            if(!volume.intersect(kv.second->volume))
-                kv.second->items.erase(id);
+        // remove from nodes it left, the nodes it stays in keep their address
+        SPItem<T> &item = items.find(id)->second;
+        for (auto kv = item.address.begin(); kv != item.address.end();) {
+            if(!volume.intersect(kv->second->volume)) {
+                kv->second->items.erase(id);
+                kv = item.address.erase(kv);
+            } else {
+                ++kv;
+            }
         }
 
-        insert(id, volume);
+        item.volume = volume;
+        recursiveInsert(&root, id, volume);
+    }
+
+    // Replace the contents with volumes[i] as item i. Items are handed
+    // down in bulk and subtrees below the first levels build in parallel,
+    // far cheaper than update() per item when most of them moved.
+    void rebuild(const std::vector<T> &volumes)
+    {
+        root = SPNode<T>(root.volume, 0, 0);
+        items.clear();
+
+        std::vector<size_t> ids(volumes.size());
+        for (size_t id = 0; id < ids.size(); ++id)
+            ids[id] = id;
+
+        recursiveBuild(&root, volumes, ids);
+
+        // node ids and addresses are shared state, filled in one pass
+        for (size_t id = 0; id < volumes.size(); ++id)
+            items.emplace_hint(items.end(), id, SPItem<T>(volumes[id]));
+
+        nextNodeId = 1;
+        recursiveAddress(&root);
     }
 
     template <class C>
@@ -318,6 +415,46 @@ private:
             recursiveInsert(&child, id, volume);
     }
 
+    void recursiveBuild(SPNode<T> *node, const std::vector<T> &volumes,
+        const std::vector<size_t> &ids)
+    {
+        std::vector<size_t> inside;
+        for (size_t id : ids) {
+            if(node->volume.intersect(volumes[id]))
+                inside.push_back(id);
+        }
+
+        // same split rule as recursiveInsert()
+        unsigned int depth = node->depth + 1;
+
+        if(inside.size() <= maxBinSize || depth >= maxDepth) {
+            node->items.insert(inside.begin(), inside.end());
+            return;
+        }
+
+        for(const T& volume : node->volume.subdivide())
+            node->children.push_back(SPNode<T>(volume, depth, 0));
+
+        // two levels give enough subtrees to keep every thread busy
+        size_t minChunk = depth <= 2 ? 1 : node->children.size();
+
+        parallelFor(0, node->children.size(), minChunk, [&](size_t begin, size_t end) {
+            for(size_t c = begin; c < end; ++c)
+                recursiveBuild(&node->children[c], volumes, inside);
+        });
+    }
+
+    void recursiveAddress(SPNode<T> *node)
+    {
+        for(size_t id : node->items)
+            items[id].address.insert(std::make_pair(node->id, node));
+
+        for(SPNode<T> &child : node->children) {
+            child.id = nextNodeId++;
+            recursiveAddress(&child);
+        }
+    }
+
     template <class C>
     void recursiveSearch(SPNode<T> *node, const C &thing, std::vector<size_t> &list)
     {
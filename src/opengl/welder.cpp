@@ -0,0 +1,150 @@
+#include "welder.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace gl;
+using namespace std;
+
+#define EMPTY_SLOT 0xffffffffu
+#define MIN_SLOTS 64
+
+// attributes as a flat float array, in declaration order
+#define VERTEX_FLOATS (sizeof(Vertex) / sizeof(float))
+
+static_assert(sizeof(Vertex) == 11 * sizeof(float), "Vertex must be tightly packed floats");
+
+static inline const float *attributes(const Vertex &vertex)
+{
+	return &vertex.pos[0];
+}
+
+static inline int64_t quantize(float value, float invEpsilon)
+{
+	return (int64_t)floor((double)value * invEpsilon + 0.5);
+}
+
+VertexWelder::VertexWelder(float epsilon) : m_epsilon(epsilon),
+m_invEpsilon(epsilon > 0.0f ? 1.0f / epsilon : 0.0f)
+{
+}
+
+void VertexWelder::reserve(size_t inserts, size_t vertices)
+{
+	m_vertices.reserve(std::min(inserts, vertices));
+
+	// keep the load factor at or below one half
+	size_t capacity = MIN_SLOTS;
+	while(capacity < inserts * 2)
+		capacity *= 2;
+
+	if(capacity > m_slots.size())
+		rehash(capacity);
+}
+
+void VertexWelder::clear()
+{
+	m_vertices.clear();
+
+	for(Slot &slot : m_slots)
+		slot.index = EMPTY_SLOT;
+}
+
+unsigned int VertexWelder::insert(const Vertex &vertex)
+{
+	if((m_vertices.size() + 1) * 2 > m_slots.size())
+		rehash(std::max<size_t>(MIN_SLOTS, m_slots.size() * 2));
+
+	uint32_t h = hash(vertex);
+	size_t mask = m_slots.size() - 1;
+
+	// linear probing, stops at the first empty slot or equal vertex
+	for(size_t i = h & mask; ; i = (i + 1) & mask) {
+		Slot &slot = m_slots[i];
+
+		if(slot.index == EMPTY_SLOT) {
+			slot.hash = h;
+			slot.index = m_vertices.size();
+			m_vertices.push_back(vertex);
+
+			return slot.index;
+		}
+
+		if(slot.hash == h && equal(m_vertices[slot.index], vertex))
+			return slot.index;
+	}
+}
+
+const vector<Vertex> &VertexWelder::vertices() const
+{
+	return m_vertices;
+}
+
+vector<Vertex> &VertexWelder::vertices()
+{
+	return m_vertices;
+}
+
+float VertexWelder::epsilon() const
+{
+	return m_epsilon;
+}
+
+void VertexWelder::rehash(size_t capacity)
+{
+	vector<Slot> slots(capacity, Slot{0, EMPTY_SLOT});
+	size_t mask = capacity - 1;
+
+	// hashes are cached, vertices never need to be rehashed
+	for(const Slot &slot : m_slots) {
+		if(slot.index == EMPTY_SLOT)
+			continue;
+
+		size_t i = slot.hash & mask;
+		while(slots[i].index != EMPTY_SLOT)
+			i = (i + 1) & mask;
+
+		slots[i] = slot;
+	}
+
+	m_slots.swap(slots);
+}
+
+uint32_t VertexWelder::hash(const Vertex &vertex) const
+{
+	const float *a = attributes(vertex);
+
+	if(m_epsilon > 0.0f) {
+		int64_t cells[VERTEX_FLOATS];
+
+		for(size_t i = 0; i < VERTEX_FLOATS; ++i)
+			cells[i] = quantize(a[i], m_invEpsilon);
+
+		return (uint32_t)hashBytes(cells, sizeof(cells));
+	}
+
+	// adding zero maps -0 to +0, which compare equal
+	float values[VERTEX_FLOATS];
+
+	for(size_t i = 0; i < VERTEX_FLOATS; ++i)
+		values[i] = a[i] + 0.0f;
+
+	return (uint32_t)hashBytes(values, sizeof(values));
+}
+
+bool VertexWelder::equal(const Vertex &a, const Vertex &b) const
+{
+	if(m_epsilon <= 0.0f)
+		return a == b;
+
+	const float *x = attributes(a);
+	const float *y = attributes(b);
+
+	for(size_t i = 0; i < VERTEX_FLOATS; ++i) {
+		if(quantize(x[i], m_invEpsilon) != quantize(y[i], m_invEpsilon))
+			return false;
+	}
+
+	return true;
+}
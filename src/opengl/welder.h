@@ -0,0 +1,55 @@
+#ifndef WELDER_H
+#define WELDER_H
+
+#include <vector>
+#include <cstdint>
+
+#include "opengl.h"
+
+namespace gl {
+	// Vertex deduplication with an open addressing table keyed on a hash
+	// of every attribute. insert() probes once and either returns the
+	// index of an equal vertex or appends it.
+	//
+	// With a positive epsilon all attributes are snapped to a grid of that
+	// size before hashing and comparing, which welds the near duplicates
+	// found in scanned data. Vertices are kept as first seen, and values
+	// straddling a grid line may still end up in different cells.
+	class VertexWelder {
+		public:
+			VertexWelder(float epsilon = 0.0f);
+
+			// size the table for an expected number of inserts, e.g. the
+			// number of face corners of a shape, and the output for the
+			// expected unique vertices, e.g. the number of positions
+			void reserve(size_t inserts, size_t vertices);
+			void clear();
+
+			unsigned int insert(const Vertex &vertex);
+
+			const std::vector<Vertex> &vertices() const;
+			std::vector<Vertex> &vertices();
+
+			float epsilon() const;
+
+		private:
+			struct Slot {
+				uint32_t hash;
+				uint32_t index; // EMPTY_SLOT when unused
+			};
+
+			float m_epsilon;
+			float m_invEpsilon;
+
+			std::vector<Slot> m_slots;
+			std::vector<Vertex> m_vertices;
+
+			void rehash(size_t capacity);
+
+			uint32_t hash(const Vertex &vertex) const;
+			bool equal(const Vertex &a, const Vertex &b) const;
+	};
+
+} // namespace gl
+
+#endif